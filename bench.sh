@@ -0,0 +1,207 @@
+#!/bin/bash
+
+# bench.sh - runs the benchmark corpus, see 'make bench'
+#
+# The corpus is:
+# - easy.dat and very_difficult.dat, solved
+# - hard.dat, counting its 1546 solutions
+# - empty.dat, counting the first BENCH_EMPTY_SOLUTIONS solutions
+# - a batch of BENCH_BATCH 17 clue puzzles, generated from the known 17 clue
+#   PUZZLES_17, in turn, by random relabeling, row, column, band, and stack
+#   permutations, and transposing; the random seed is fixed, so the batch is
+#   the same each time
+#
+# Each is run BENCH_REPS times, for each of the BENCH_ENGINES, 
+# BENCH_HEURISTICS (the branching heuristics of the mrv and iter engines),
+# and BENCH_THREADS. A JSON line is written to stdout for each, with:
+# - puzzles_per_sec and nodes_per_sec, from the median run
+# - p50_ms and max_ms, the median and slowest of the run times, which 
+#   include the process start
+# - for the batch, latency_p50_us and latency_p99_us, the puzzle latencies
+#   from the stats of the median run
+# - efficiency, the scaling efficiency relative to the first thread count:
+#   p50_ms(first) * first / (p50_ms * threads)
+#
+# When BENCH_BASELINE is the output of an earlier bench the results are
+# compared with it, and those with a p50_ms more than BENCH_TOLERANCE
+# percent slower are reported on stderr; the exit status is then 1.
+
+BENCH_ENGINES=${BENCH_ENGINES:-"mrv iter dlx"}
+BENCH_HEURISTICS=${BENCH_HEURISTICS:-"mrv"}
+BENCH_THREADS=${BENCH_THREADS:-"1 2 4 8"}
+BENCH_REPS=${BENCH_REPS:-5}
+BENCH_BATCH=${BENCH_BATCH:-20000}
+BENCH_EMPTY_SOLUTIONS=${BENCH_EMPTY_SOLUTIONS:-2000000}
+BENCH_TOLERANCE=${BENCH_TOLERANCE:-10}
+BENCH_CORPUS=bench_17.txt
+
+PUZZLES_17="000000010400000000020000000000050407008000300001090000300400200050100000000806000
+            000000010400000000020000000000050604008000300001090000300400200050100000000807000
+            000000012000035000000600070700000300000400800100000000000120000080000040050000600
+            000000012003600000000007000410020000000500300700000600280000040000300500000000000
+            000000012008030000000000040120500000000004700060000000507000300000620000000100000
+            000000012040050000000009000070600400000100000000000050000087500601000300200000000"
+
+# -----------------  CORPUS  --------------------------------------
+
+gen_corpus()
+{
+    # generate the batch of 17 clue puzzles, each is equivalent to one of 
+    # PUZZLES_17 and so has a unique solution
+    awk -v puzzles="$PUZZLES_17" -v n=$BENCH_BATCH '
+        function shuffle(a, len,   i, j, t) {
+            for (i = len - 1; i > 0; i--) {
+                j = int(rand() * (i + 1))
+                t = a[i]; a[i] = a[j]; a[j] = t
+            }
+        }
+        BEGIN {
+            srand(1)
+            num_puzzles = split(puzzles, puzzle_tbl)
+            for (k = 0; k < n; k++) {
+                puzzle = puzzle_tbl[k % num_puzzles + 1]
+
+                # the row and column orders: the bands, and the rows
+                # within each band, are shuffled; and the same for columns
+                for (i = 0; i < 3; i++) { band[i] = i; stack[i] = i }
+                shuffle(band, 3); shuffle(stack, 3)
+                for (i = 0; i < 3; i++) {
+                    for (j = 0; j < 3; j++) { r[j] = j; c[j] = j }
+                    shuffle(r, 3); shuffle(c, 3)
+                    for (j = 0; j < 3; j++) {
+                        row[3*i+j] = 3*band[i] + r[j]
+                        col[3*i+j] = 3*stack[i] + c[j]
+                    }
+                }
+                for (i = 0; i < 9; i++) { digit[i] = i + 1 }
+                shuffle(digit, 9)
+                transpose = (rand() < 0.5)
+
+                s = ""
+                for (i = 0; i < 9; i++) {
+                    for (j = 0; j < 9; j++) {
+                        loc = (transpose ? col[j] * 9 + row[i] : row[i] * 9 + col[j])
+                        v = substr(puzzle, loc + 1, 1)
+                        s = s (v == "0" ? "." : digit[v - 1])
+                    }
+                }
+                print s
+            }
+        }' > $BENCH_CORPUS
+}
+
+# -----------------  RUN  -----------------------------------------
+
+to_number()
+{
+    # convert the numeric_str format, for example "4.497 thousand", to a number
+    echo "$@" | awk '{ m = 1
+                       if ($2 == "thousand") m = 1e3
+                       if ($2 == "million")  m = 1e6
+                       if ($2 == "billion")  m = 1e9
+                       if ($2 == "trillion") m = 1e12
+                       printf "%d\n", $1 * m }'
+}
+
+bench()
+{
+    local name=$1 engine=$2 heuristic=$3 threads=$4 puzzles=$5
+    shift 5
+    local i start end runs nodes lat50 lat99 p50 max first_threads first_p50
+
+    # run the benchmark BENCH_REPS times, after one warm up run; for each run
+    # keep its time, in microseconds, its nodes, and its puzzle latencies, 
+    # which are printed in batch mode
+    ./sudoku -e $engine -B $heuristic "$@" > /dev/null 2>&1
+    runs=""
+    for ((i = 0; i < BENCH_REPS; i++)); do
+        start=$(date +%s%N)
+        ./sudoku -e $engine -B $heuristic "$@" > $out 2>&1
+        end=$(date +%s%N)
+        nodes=$(to_number $(grep "^num_nodes " $out | sed 's/.*= //'))
+        lat50=$(grep "^latency_p50 " $out | awk '{ print $3 }')
+        lat99=$(grep "^latency_p99 " $out | awk '{ print $3 }')
+        runs="$runs$(( (end - start) / 1000 )) $nodes ${lat50:-0} ${lat99:-0}\n"
+    done
+
+    # the median run, and the slowest run time
+    read p50 nodes lat50 lat99 max <<< $(printf "$runs" | sort -n |
+                                         awk '{ r[NR] = $0; t = $1 }
+                                              END { print r[int((NR + 1) / 2)], t }')
+
+    # the scaling efficiency is relative to the first thread count
+    key="$name $engine $heuristic"
+    if [ -z "${first[$key]}" ]; then
+        first[$key]="$threads $p50"
+    fi
+    read first_threads first_p50 <<< ${first[$key]}
+
+    awk -v name=$name -v engine=$engine -v heuristic=$heuristic -v threads=$threads -v puzzles=$puzzles \
+        -v nodes=$nodes -v p50=$p50 -v max=$max -v lat50=$lat50 -v lat99=$lat99 \
+        -v ft=$first_threads -v fp50=$first_p50 '
+        BEGIN {
+            printf "{\"name\":\"%s\",\"engine\":\"%s\",\"heuristic\":\"%s\",\"threads\":%d,\"puzzles\":%d,",
+                   name, engine, heuristic, threads, puzzles
+            printf "\"puzzles_per_sec\":%.1f,\"nodes_per_sec\":%.0f,",
+                   puzzles * 1e6 / p50, nodes * 1e6 / p50
+            printf "\"p50_ms\":%.3f,\"max_ms\":%.3f,", p50 / 1000, max / 1000
+            if (puzzles > 1) {
+                printf "\"latency_p50_us\":%.1f,\"latency_p99_us\":%.1f,", lat50, lat99
+            }
+            printf "\"efficiency\":%.2f}\n", (fp50 * ft) / (p50 * threads)
+        }'
+}
+
+# -----------------  MAIN  ----------------------------------------
+
+declare -A first
+out=$(mktemp)
+
+if [ ! -x ./sudoku ]; then
+    echo "ERROR: ./sudoku not found, run make" >&2
+    exit 1
+fi
+gen_corpus
+
+results=$(mktemp)
+for engine in $BENCH_ENGINES; do
+    for heuristic in $BENCH_HEURISTICS; do
+        # the heuristics are of the mrv and iter engines
+        if [ $engine == dlx ] && [ $heuristic != ${BENCH_HEURISTICS%% *} ]; then
+            continue
+        fi
+        for threads in $BENCH_THREADS; do
+            bench easy            $engine $heuristic $threads 1 easy.dat $threads
+            bench very_difficult  $engine $heuristic $threads 1 very_difficult.dat $threads
+            bench hard_count      $engine $heuristic $threads 1 -c hard.dat $threads
+            bench empty_count     $engine $heuristic $threads 1 -c empty.dat $threads 1 $BENCH_EMPTY_SOLUTIONS
+            bench batch_17        $engine $heuristic $threads $BENCH_BATCH -b $BENCH_CORPUS $threads
+        done
+    done
+done | tee $results
+
+# compare with the baseline
+status=0
+if [ -n "$BENCH_BASELINE" ]; then
+    awk -v tol=$BENCH_TOLERANCE '
+        function field(s, name,   re) {
+            re = "\"" name "\":\"?[^,\"}]*"
+            match(s, re)
+            s = substr(s, RSTART, RLENGTH)
+            sub(/^"[^"]*":"?/, "", s)
+            return s
+        }
+        { h = field($0, "heuristic"); if (h == "") h = "mrv"
+          key = field($0, "name") " " field($0, "engine") " " h " " field($0, "threads") }
+        FNR == NR { base[key] = field($0, "p50_ms"); next }
+        key in base {
+            cur = field($0, "p50_ms") + 0
+            if (cur > base[key] * (1 + tol / 100)) {
+                printf "REGRESSION: %s p50_ms %.3f, baseline %.3f\n", key, cur, base[key] > "/dev/stderr"
+                regressions++
+            }
+        }
+        END { exit (regressions > 0) }' "$BENCH_BASELINE" $results || status=1
+fi
+rm -f $results $out
+exit $status
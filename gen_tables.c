@@ -0,0 +1,175 @@
+/*
+Copyright (c) 2017 Steven Haid
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+// gen_tables - generates sudoku_tables.h, the read-only tables of libsudoku
+//
+// usage: gen_tables <box>
+//
+// The tables are generated at build time, see the Makefile, so that they are
+// constant data in libsudoku rather than being built when a context is 
+// first created. They are for the board size with boxes of width box, so of
+// n = box * box values; sudoku_tables.h is for 9x9, sudoku_tables16.h for
+// 16x16, and sudoku_tables25.h for 25x25. The tables are:
+// - units_of: the units (row, col, grid) of a location
+// - unit_locs: the locations of a unit, rows are units 0 to n-1, cols are 
+//   units n to 2n-1, grids are units 2n to 3n-1
+// and for 9x9 only:
+// - pv2val: converts a possible value bitmask, with one bit set, to the value;
+//   for the larger sizes libsudoku uses count trailing zeros
+// - kernel_shuffle: the avx2 kernel's byte shuffle controls; the low byte 
+//   of a location's 16 bit lane selects the location's row, col, or grid
+//   from a table of 9, the high byte and the lanes past location 80 select zero
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+//
+// defines
+//
+
+#define MAX_BOX 5
+#define MAX_N   (MAX_BOX * MAX_BOX)
+
+#define ROW(locidx) (locidx / n)
+#define COL(locidx) (locidx % n)
+#define GRID_NUM(locidx) (ROW(locidx) / box * box + COL(locidx) / box)
+
+//
+// variables
+//
+
+uint32_t box, n;
+uint16_t pv2val[513];
+uint16_t units_of[MAX_N*MAX_N][3];
+uint16_t unit_locs[3*MAX_N*MAX_N];    // unit_locs[unit * n + i]
+uint16_t kernel_shuffle[3][192];
+
+//
+// prototypes
+//
+
+void print_table(char * decl, char * comment, uint16_t * table, uint32_t rows, uint32_t cols);
+
+// -----------------  MAIN  ----------------------------------------
+
+int main(int argc, char ** argv)
+{
+    uint32_t locidx, unit, max_loc, i;
+    uint8_t value;
+    char decl[100];
+
+    // get the box width arg
+    if (argc != 2 || sscanf(argv[1], "%u", &box) != 1 || box < 3 || box > MAX_BOX) {
+        fprintf(stderr, "usage: gen_tables <box>\n");
+        exit(1);
+    }
+    n = box * box;
+
+    // init possible-val to val converter
+    for (value = 1; value <= 9; value++) {
+        pv2val[1<<value] = value;
+    }
+
+    // init the units of each location, and the locations of each unit
+    for (locidx = 0; locidx < n*n; locidx++) {
+        units_of[locidx][0] = ROW(locidx);
+        units_of[locidx][1] = n + COL(locidx);
+        units_of[locidx][2] = 2*n + GRID_NUM(locidx);
+    }
+    for (unit = 0; unit < 3*n; unit++) {
+        for (max_loc = 0, locidx = 0; locidx < n*n; locidx++) {
+            if (units_of[locidx][0] == unit ||
+                units_of[locidx][1] == unit ||
+                units_of[locidx][2] == unit)
+            {
+                unit_locs[unit * n + max_loc++] = locidx;
+            }
+        }
+        assert(max_loc == n);
+    }
+
+    // init the avx2 kernel shuffle controls, the kernel is for 9x9
+    for (locidx = 0; box == 3 && locidx < 96; locidx++) {
+        for (i = 0; i < 3; i++) {
+            kernel_shuffle[i][2*locidx]   = (locidx < 81 ? units_of[locidx][i] - 9 * i : 0x80);
+            kernel_shuffle[i][2*locidx+1] = 0x80;
+        }
+    }
+
+    // print the header; the locations of a unit are uint8_t, except
+    // for 25x25 which has 625 locations
+    printf("// generated by gen_tables, do not edit\n\n");
+    printf("#ifndef __SUDOKU_TABLES_H__\n");
+    printf("#define __SUDOKU_TABLES_H__\n\n");
+    printf("#if SUDOKU_BOX != %d\n", box);
+    printf("#error \"sudoku tables are for SUDOKU_BOX %d\"\n", box);
+    printf("#endif\n\n");
+    if (box == 3) {
+        print_table("static const uint8_t pv2val[513]",
+                    "convert possible value bitmask to value",
+                    pv2val, 1, 513);
+    }
+    sprintf(decl, "static const uint8_t units_of[%d][3]", n*n);
+    print_table(decl, 
+                "units (row, col, grid) of a location",
+                &units_of[0][0], n*n, 3);
+    sprintf(decl, "static const %s unit_locs[%d][%d]", (n*n > 256 ? "uint16_t" : "uint8_t"), 3*n, n);
+    print_table(decl,
+                "locations of a unit, rows are units 0 to n-1, cols are units n to 2n-1, grids are units 2n to 3n-1",
+                unit_locs, 3*n, n);
+    if (box == 3) {
+        print_table("static const uint8_t kernel_shuffle[3][192] __attribute__((aligned(32), unused))",
+                    "avx2 kernel shuffle controls, that get the row, col, and grid bitmasks of 96 locations",
+                    &kernel_shuffle[0][0], 3, 192);
+    }
+    printf("#endif\n");
+
+    // return success
+    return 0;
+}
+
+void print_table(char * decl, char * comment, uint16_t * table, uint32_t rows, uint32_t cols)
+{
+    uint32_t r, c;
+
+    // print the table; a 2 dimensional table has the values of a row in 
+    // braces, and a line has up to 16 values
+    printf("// %s\n", comment);
+    printf("%s = {\n", decl);
+    for (r = 0; r < rows; r++) {
+        for (c = 0; c < cols; c++) {
+            if (c % 16 == 0) {
+                printf("    %s", (rows == 1 ? "" : c == 0 ? "{ " : "  "));
+            }
+            printf("%3d,", table[r * cols + c]);
+            if (c == cols - 1) {
+                printf("%s\n", (rows == 1 ? "" : " },"));
+            } else if (c % 16 == 15) {
+                printf("\n");
+            }
+        }
+    }
+    printf("};\n\n");
+}
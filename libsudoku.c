@@ -0,0 +1,5424 @@
+/*
+Copyright (c) 2017 Steven Haid
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// libsudoku - the sudoku solver library, see sudoku.h
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+#include <sched.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include <limits.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "sudoku.h"
+#if SUDOKU_BOX == 3
+#include "sudoku_tables.h"
+#elif SUDOKU_BOX == 4
+#include "sudoku_tables16.h"
+#else
+#include "sudoku_tables25.h"
+#endif
+
+//
+// defines
+//
+
+// #define VERIFY_SOLUTIONS
+#define VERIFY_SHARDS          256                      // duplicate solution check hash set, number of
+#define VERIFY_MAX_MEMORY      (4096L * 1024 * 1024)    //  shards, and the memory budget of all shards
+
+#define BOX_SIZE               SUDOKU_BOX      // board size, set at compile time, see sudoku.h
+#define MAX_VALUE              SUDOKU_N        // values are 1 to MAX_VALUE, and a unit has MAX_VALUE locations
+#define MAX_LOC                SUDOKU_CELLS
+#define MAX_UNIT               (3 * MAX_VALUE)
+#define ALL_VALUES             ((mask_t)((1U << (MAX_VALUE + 1)) - 2))   // bitmask of the values, 0x3fe for 9x9
+
+#define NO_VALUE               SUDOKU_NO_VALUE
+#define MAX_SOLUTIONS_INFINITE SUDOKU_MAX_SOLUTIONS_INFINITE
+#define PACKED_SIZE            SUDOKU_PACKED_SIZE
+
+#define DEFAULT_MAX_THREADS    4
+#define DEQUE_SIZE             1024   // must be power of 2
+#define PAGE_SIZE              4096   // a worker is in its own pages, see pool_create
+#define AFFINITY_MAX_NODES     64     // numa nodes examined when pinning the workers
+#define SLAB_TASKS             256    // tasks allocated at once, by a worker's task pool
+#define BATCH_CHUNK_SIZE       (256 * 1024)             // batch input is claimed by workers in chunks,
+#define BATCH_MIN_CHUNK_SIZE   1024                     //  of at most, and at least, these sizes
+#define BATCH_WINDOW_CHUNKS    64                       // number of chunks solved in a run
+#define BATCH_WINDOW_SIZE      (BATCH_CHUNK_SIZE * BATCH_WINDOW_CHUNKS)
+#define BATCH_MAX_OUT_LINE     (MAX_LOC + 23)           // max length of a batch result line
+#define GENERATE_CHUNK_PUZZLES 16                       // generated puzzles are claimed by workers in chunks
+
+#define CACHE_SHARDS           64      // result cache, number of shards, and entries per bucket
+#define CACHE_WAYS             4
+#define CANON_MAX_TRANSFORMS   4096    // puzzles with more transforms to compare are not cached
+
+#define FORMAT_TEXT            SUDOKU_FORMAT_TEXT
+#define FORMAT_PACKED          SUDOKU_FORMAT_PACKED
+#define MAX_FORMAT             2
+
+#define SINK_RING_SIZE         (1024 * 1024)   // per worker output ring, must be power of 2
+#define SINK_MAX_IOV           256             // max records written by one writev
+
+#define COUNT_RESERVE_BATCH    1024    // max solutions reserved at once, in count only mode
+
+#define ORDER_ANY              SUDOKU_ORDER_ANY
+#define ORDER_SEQ              SUDOKU_ORDER_SEQ
+#define MAX_ORDER              2
+
+#define STRATEGY_NAKED_SINGLES  0
+#define STRATEGY_HIDDEN_SINGLES 1
+#define STRATEGY_NAKED_PAIRS    2
+#define STRATEGY_NAKED_TRIPLES  3
+#define MAX_STRATEGY            SUDOKU_MAX_STRATEGY
+
+#define DEFAULT_STRATEGIES     "naked"
+
+#define ENGINE_MRV             SUDOKU_ENGINE_MRV
+#define ENGINE_DLX             SUDOKU_ENGINE_DLX
+#define ENGINE_ITER            SUDOKU_ENGINE_ITER
+#define MAX_ENGINE             3
+
+#define HEURISTIC_MRV          SUDOKU_HEURISTIC_MRV
+#define HEURISTIC_DEGREE       SUDOKU_HEURISTIC_DEGREE
+#define HEURISTIC_LCV          SUDOKU_HEURISTIC_LCV
+#define HEURISTIC_RESTART      SUDOKU_HEURISTIC_RESTART
+#define MAX_HEURISTIC          SUDOKU_MAX_HEURISTIC
+#define RESTART_NODES          256     // node limit of the first search of the restart heuristic,
+                                       //  it is doubled for each restart
+
+#define KERNEL_AUTO            SUDOKU_KERNEL_AUTO
+#define KERNEL_SCALAR          SUDOKU_KERNEL_SCALAR
+#define KERNEL_AVX2            SUDOKU_KERNEL_AVX2
+#define MAX_KERNEL             3
+
+#define MAX_TRAIL              (MAX_LOC * MAX_VALUE)   // changes are MAX_LOC values set, and at most 
+                                                       //  MAX_VALUE-1 eliminations from each location
+#define DLX_MAX_COL            (4 * MAX_LOC)           // MAX_LOC locations, and MAX_VALUE values in each of MAX_UNIT units
+#define DLX_MAX_ROW            (MAX_LOC * MAX_VALUE)   // MAX_LOC locations times MAX_VALUE values
+#define DLX_MAX_NODE           (1 + DLX_MAX_COL + 4 * DLX_MAX_ROW)
+#define DEFAULT_SPLIT_DEPTH_MRV 16     // the search creates tasks down to this depth,
+#define DEFAULT_SPLIT_DEPTH_DLX 3      //  by default
+#define MAX_TASK_SIZE_HIST     SUDOKU_MAX_TASK_SIZE_HIST
+#define MAX_LATENCY_HIST       SUDOKU_MAX_LATENCY_HIST
+#define LATENCY_SUB_BITS       4      // the latency_hist has 2^LATENCY_SUB_BITS buckets per power of 2
+#define MAX_SLOWEST            SUDOKU_MAX_SLOWEST
+#define ASYNC_QUEUE_SIZE       SUDOKU_ASYNC_QUEUE_SIZE  // must be power of 2
+#define ASYNC_STOPPING         0x80000000  // set in async_submitting by sudoku_async_stop
+#define DEFAULT_PRINT_INTERVAL 1000000
+#define DEFAULT_METRICS_INTERVAL_MS 1000
+#define DEFAULT_CHECKPOINT_INTERVAL 60 // seconds
+#define CHECKPOINT_MAGIC       "SUDOKUCP"
+#define CHECKPOINT_VERSION     1
+#define DEFAULT_MAX_SOLUTIONS  MAX_SOLUTIONS_INFINITE
+
+#define ROW(locidx) (locidx / MAX_VALUE)
+#define COL(locidx) (locidx % MAX_VALUE)
+#define GRID_NUM(locidx) (ROW(locidx) / BOX_SIZE * BOX_SIZE + COL(locidx) / BOX_SIZE)
+
+// the possible values bitmask of a single value; the 9x9 table is generated
+// by gen_tables, it is faster than count trailing zeros in the kernels
+#if BOX_SIZE == 3
+#define PV2VAL(pv) pv2val[pv]
+#else
+#define PV2VAL(pv) __builtin_ctz(pv)
+#endif
+
+//
+// typedefs
+//
+
+// a bitmask of values has bit n set for value n, 16 bits are enough for 9x9
+#if MAX_VALUE < 16
+typedef uint16_t mask_t;
+#else
+typedef uint32_t mask_t;
+#endif
+
+// a location index, 8 bits are enough for 9x9 and 16x16
+#if MAX_LOC <= 256
+typedef uint8_t loc_t;
+#else
+typedef uint16_t loc_t;
+#endif
+
+typedef sudoku_puzzle_t puzzle_t;
+typedef sudoku_strategy_stats_t strategy_stats_t;
+typedef sudoku_request_t request_t;
+typedef struct sudoku_pool pool_t;
+
+typedef struct {
+    puzzle_t p;
+    mask_t   used[MAX_UNIT];            // bitmask of the values used in each unit,
+                                        //  bit n is set when value n is used
+    mask_t   excluded[(MAX_LOC + 15) / 16 * 16];
+                                        // bitmask of values eliminated from a location
+                                        //  by the naked pairs and triples strategies,
+                                        //  padded to a multiple of 16 for the avx2 kernel
+    uint32_t depth;                     // number of branch decisions made  
+    struct trail * trail;               // when set the changes are logged here, so 
+                                        //  they can be undone; see the iter engine
+} board_t;
+
+typedef struct {
+    loc_t    locidx;
+    bool     set;                       // the value was set, else excluded was changed
+    mask_t   excluded;                  // the location's excluded bitmask before the change
+} trail_ent_t;
+
+typedef struct trail {
+    uint32_t    max_ent;
+    trail_ent_t ent[MAX_TRAIL];
+} trail_t;
+
+typedef struct {
+    uint32_t trail_pos;                 // the trail before the branch location's value was set
+    uint32_t locidx;                    // the branch location
+    uint32_t pv;                        // bitmask of the values not yet tried
+    uint8_t  num_order;                 // the order the values are tried in, when set by the
+    uint8_t  next;                      //  branching heuristic; 0 when tried in numeric order
+    uint8_t  order[MAX_VALUE];
+} frame_t;
+
+typedef struct {
+    board_t  b;                         // the board, changed in place by the search
+    trail_t  trail;
+    frame_t  stack[MAX_LOC];            // a frame for each branch decision
+} iter_t;
+
+typedef struct {
+    uint16_t L[DLX_MAX_NODE];           // node 0 is the root, followed by the column headers,     
+    uint16_t R[DLX_MAX_NODE];           //  followed by 4 nodes for each row
+    uint16_t U[DLX_MAX_NODE];
+    uint16_t D[DLX_MAX_NODE];
+    uint16_t C[DLX_MAX_NODE];           // column header of a node
+    uint16_t row[DLX_MAX_NODE];         // row of a node, row = locidx * MAX_VALUE + value - 1
+    uint16_t S[1 + DLX_MAX_COL];        // number of nodes in a column
+    uint16_t O[MAX_LOC];                // rows selected by the search
+    board_t  b;                         // the board the search started from
+} dlx_t;
+
+typedef struct {
+    char * name;
+    int32_t (*proc)(board_t * b);       // returns -1 for contradiction, else number of changes
+} strategy_t;
+
+// a naked singles kernel makes one pass over the blank locations, setting
+// those with one possible value; it returns -1 for contradiction, else the
+// number of values set, and when none are set the location with the least
+// number of possible values
+typedef int32_t (*kernel_t)(board_t * b, uint32_t * best_locidx, uint32_t * best_pv, uint32_t * best_num_pv);
+
+typedef struct task {
+    board_t       b;                    // the branch state
+    struct task * next;                 // free list
+    struct worker * owner;              // the worker whose slab the task is in
+} task_t;
+
+typedef struct slab {
+    struct slab * next;
+    task_t        task[SLAB_TASKS];
+} slab_t;
+
+typedef struct {
+    puzzle_t puzzle;                    // the puzzle
+    puzzle_t solution;                  // the first solution found
+    uint64_t num_solutions;
+    uint64_t max_solutions;             // the search stops when num_solutions reaches this, or
+                                        //  MAX_SOLUTIONS_INFINITE; ctx->max_solutions, or 2 when
+                                        //  checking uniqueness
+    bool     print;                     // output solutions, to the sink and solution_cb
+    bool     split;                     // branch states may be pushed on the worker deques
+    bool     count;                     // count only, using the worker counters
+    uint64_t num_reserved;              // count only, solutions reserved by the workers
+    uint64_t id;                        // identifies the job's puzzle, for the duplicate solution check
+    bool     checkpoint;                // the job is checkpointed, to ctx->checkpoint_file
+    bool     from_frontier;             // the job starts with the branch states of the pool's frontier,
+                                        //  when resumed from a checkpoint, or symmetry reduced
+    uint64_t prior_nodes;               // resumed only, nodes examined and time spent before
+    uint64_t prior_us;                  //  the checkpoint
+    uint64_t start_nodes;               // the context's nodes and duration at the start of the job
+    uint64_t start_us;
+} job_t;
+
+typedef struct {
+    uint64_t count;                     // solutions counted, not yet added to the job
+    uint64_t reserved;                  // solutions reserved, not yet counted
+} __attribute__((aligned(64))) counter_t;
+
+typedef struct {
+    char   * start;                     // the lines of the chunk, in the batch input
+    char   * end;
+    char   * out;                       // the results of the chunk's puzzles
+    size_t   out_len;
+    char   * error;                     // the invalid puzzle that stopped the chunk
+    uint64_t first;                     // the number of the chunk's first puzzle, set before the
+                                        //  chunk is run for generate, and after it is run for batch
+    uint64_t count;                     // generate only, the number of puzzles to generate
+    uint64_t num_clues;                 // generate only, stats
+    uint64_t num_puzzles;               // stats
+    uint64_t num_solved;
+    uint64_t num_solutions;
+} chunk_t;
+
+typedef struct {
+    uint64_t ns;                        // time spent solving the batch puzzle, 0 for unused entries
+    uint64_t id;                        // the puzzle number; or while chunk is set, the index of 
+    chunk_t * chunk;                    //  the puzzle in the chunk, until the chunk's first is set
+} slowest_t;
+
+typedef struct {
+    uint64_t    seq;                    // the position the cell can be pushed, or popped, at
+    request_t * req;
+} async_cell_t;
+
+typedef struct {
+    uint64_t     head __attribute__((aligned(64)));     // position of the next push
+    uint64_t     tail __attribute__((aligned(64)));     // position of the next pop
+    async_cell_t cell[ASYNC_QUEUE_SIZE] __attribute__((aligned(64)));
+} async_queue_t;
+
+typedef struct {
+    uint64_t ts;                        // solution number
+    uint32_t len;                       // length of the output that follows
+    uint32_t wrap;                      // the rest of the ring is unused, continue at its start
+} sink_rec_t;
+
+typedef struct {
+    uint64_t head __attribute__((aligned(64)));     // advanced by the worker, when a record is added
+    uint64_t tail __attribute__((aligned(64)));     // advanced by the writer, when a record is written
+    char     buff[SINK_RING_SIZE] __attribute__((aligned(64)));
+} sink_ring_t;
+
+typedef struct worker {
+    pthread_t       thread_id;
+    uint32_t        id;
+    int32_t         cpu;                // the cpu the worker is pinned to, -1 when not pinned,
+    uint32_t        node;               //  and its numa node
+    sudoku_ctx_t  * ctx;
+    pool_t        * pool;
+    pthread_mutex_t deque_mutex;        // protects deque_top and deque_bottom
+    uint64_t        deque_top;          // thieves steal here, the shallowest branch states
+    uint64_t        deque_bottom;       // owner pushes and pops here, the deepest
+    uint64_t        num_tasks;          // stats
+    uint64_t        num_steals;
+    uint64_t        num_remote_steals;  // steals from a worker on another numa node
+    uint64_t        num_nodes;
+    uint64_t        num_solutions;
+    uint64_t        busy_us;            // time spent running tasks, not including the current task
+    uint64_t        busy_since;         // start time of the current task, 0 when idle
+    strategy_stats_t strategy_stats[MAX_STRATEGY];
+    uint64_t        task_size_hist[MAX_TASK_SIZE_HIST];
+    uint64_t        max_task_size;
+    uint64_t        cache_hits;
+    uint64_t        cache_misses;
+    uint64_t        heuristic_nodes[MAX_HEURISTIC];
+    uint64_t        num_restarts;
+    uint64_t        latency_hist[MAX_LATENCY_HIST];
+    slowest_t       slowest[MAX_SLOWEST];
+    uint64_t        slowest_min_ns;     // the fastest of the slowest, 0 when there is an unused entry
+    uint64_t        async_puzzles;      // async requests completed, and their stats, added to the
+    uint64_t        async_solved;       //  ctx stats when serving is stopped
+    uint64_t        async_solutions;
+    uint64_t        node_limit;         // restart heuristic: the search stops at this many nodes,
+    bool            node_limit_hit;     //  0 for no limit; and the search was stopped by it
+    bool            randomize;          // restart heuristic: ties are broken at random, using rng
+    uint64_t        rng;
+    puzzle_t      * frontier;           // branch states saved when checkpointing
+    uint32_t        max_frontier;
+    uint32_t        frontier_alloc;
+    dlx_t         * dlx;                // allocated when the dlx engine is used
+    iter_t        * iter;               // allocated when the iter engine is used
+    job_t         * job;                // the job of the task being run
+    sink_ring_t   * sink;               // the worker's solution output
+    counter_t       counter;            // count only mode solution counter
+    task_t        * task_free;          // the worker's free tasks, used just by the worker
+    slab_t        * task_slabs;         // the slabs of the worker's tasks
+    task_t        * task_returned       // tasks freed by other workers, pushed lock free
+                    __attribute__((aligned(64)));
+    task_t        * deque[DEQUE_SIZE] __attribute__((aligned(64)));
+} __attribute__((aligned(PAGE_SIZE))) worker_t;
+
+typedef struct {
+    sudoku_ctx_t  * ctx;                // the args of a worker thread, it inits its own worker
+    uint32_t        id;
+} worker_start_t;
+
+struct sudoku_pool {
+    worker_t      * workers;            // worker thread pool
+    uint32_t        num_idle;           // number of workers without a task
+    uint32_t        num_waiting;        // number of workers waiting for a run
+    uint32_t        generation;         // incremented to start a run
+    bool            shutdown;           // set to terminate the workers
+    bool            done;               // set when the run is complete
+    pthread_mutex_t mutex;              // protects the above
+    pthread_cond_t  run_cond;           // signals a run is started
+    pthread_cond_t  done_cond;          // signals a run is done
+    uint32_t        num_threads;        // number of worker threads running
+    int32_t       * worker_cpu;         // when pinned, the cpu of each worker, and its numa node;
+    uint32_t      * worker_node;        //  NULL when not pinned
+    uint32_t        num_nodes;          // numa nodes the workers are on
+    uint64_t        start_us;           // time of the run
+    uint64_t        end_us;
+    kernel_t        naked_singles;      // the naked singles kernel selected
+
+    job_t         * deque_job;          // the job of the branch states on the deques
+    chunk_t       * batch_chunks;       // batch input chunks, claimed by the workers
+    uint32_t        max_batch_chunks;
+    uint32_t        batch_next;         // index of the next batch chunk to claim
+    char          * batch_input;        // start of the batch input
+    bool            generate;           // the batch chunks are of generated puzzles
+    uint64_t        generate_seed;
+
+    volatile bool   checkpoint;         // set to stop the run, saving the branch states in the frontiers
+    puzzle_t      * frontier;           // the branch states the run is started from, claimed 
+    uint64_t        max_frontier;       //  by the workers
+    uint64_t        frontier_alloc;
+    uint64_t        frontier_next;      // index of the next branch state to claim
+    uint64_t        prior_nodes;        // nodes examined by solves before they were resumed
+
+    pthread_t       sink_thread_id;     // the output sink writer thread, for the life of the context
+    volatile bool   sink_shutdown;      //  once created
+    bool            sink_active;        // the solve's solutions are written to the sink
+    uint64_t        sink_next_ts;       // seq order, the next solution number to be written
+    volatile bool   sink_sleeping;      // the writer is waiting on sink_cond for records
+    volatile bool   sink_flushing;      // sink_flush is waiting on sink_flush_cond
+    pthread_mutex_t sink_mutex;         // protects waiting on sink_cond and sink_flush_cond
+    pthread_cond_t  sink_cond;          // signals a record is added, or sink_shutdown is set
+    pthread_cond_t  sink_flush_cond;    // signals records are written
+
+    pthread_t       metrics_thread_id;  // the metrics thread
+    pthread_cond_t  metrics_cond;       // signals metrics_shutdown is set
+    bool            metrics_shutdown;
+    uint64_t        create_us;          // time the context was created
+
+    bool            async;              // the run serves the async requests, until async_stop is set
+    volatile bool   async_stop;
+    async_queue_t * async_sq;           // requests submitted, claimed by the workers,
+    async_queue_t * async_cq;           //  and requests completed, to be reaped
+    uint32_t        async_inflight;     // requests submitted and not yet reaped
+    uint32_t        async_sleepers;     // workers waiting on async_cond for a request
+    uint32_t        async_submitting;   // submits in progress, and ASYNC_STOPPING
+    uint32_t        async_notify;       // set when async_fd is written, cleared by reap
+    int             async_fd;           // eventfd, readable when there are requests to reap
+    uint64_t        async_next_id;      // identifies the requests' puzzles, see job_t id
+    pthread_mutex_t async_mutex;        // protects waiting on async_cond
+    pthread_cond_t  async_cond;         // signals a request is submitted, or async_stop is set
+
+    struct cache  * cache;              // batch result cache, when ctx->cache_memory is set
+    struct verify_set * verify;         // solutions found, when VERIFY_SOLUTIONS is defined
+};
+
+//
+// variables
+//
+
+// the read-only tables pv2val, units_of, unit_locs, and kernel_shuffle are 
+// generated at build time by gen_tables, in sudoku_tables.h
+
+pthread_once_t initialize_once = PTHREAD_ONCE_INIT; // the dlx template is initialized once, for all contexts
+
+//
+// progotypes
+//
+
+static void initialize(void);
+static void stats_update(sudoku_ctx_t * ctx);
+static void find_solutions(worker_t * w, board_t b);
+static int32_t propagate(worker_t * w, board_t * b, uint32_t * best_locidx, uint32_t * best_pv, uint32_t * best_num_pv);
+static void record_solution(worker_t * w, puzzle_t * p);
+static void count_flush(worker_t * w);
+static uint32_t branch_select(worker_t * w, board_t * b, uint32_t * best_locidx, uint32_t * best_pv, uint32_t best_num_pv, uint8_t * order);
+static void restart_find_solutions(worker_t * w, board_t * b);
+static void dlx_init(void);
+static void dlx_find_solutions(worker_t * w, board_t * b);
+static void iter_find_solutions(worker_t * w, board_t * b);
+static bool board_init(board_t * b, puzzle_t * p);
+static bool pipeline_select(sudoku_ctx_t * ctx, char * names);
+static int32_t naked_singles_scalar(board_t * b, uint32_t * best_locidx, uint32_t * best_pv, uint32_t * best_num_pv);
+#if defined(__x86_64__) && BOX_SIZE == 3
+static int32_t naked_singles_avx2(board_t * b, uint32_t * best_locidx, uint32_t * best_pv, uint32_t * best_num_pv);
+#endif
+static int32_t hidden_singles(board_t * b);
+static int32_t naked_pairs(board_t * b);
+static int32_t naked_triples(board_t * b);
+static void pool_create(sudoku_ctx_t * ctx);
+static void affinity_select(sudoku_ctx_t * ctx);
+static void pool_run(sudoku_ctx_t * ctx, uint32_t checkpoint_interval);
+static void pool_start(sudoku_ctx_t * ctx);
+static void pool_wait(sudoku_ctx_t * ctx, uint32_t checkpoint_interval);
+static void pool_destroy(sudoku_ctx_t * ctx);
+static void run_task(worker_t * w, board_t * b);
+static void sink_create(sudoku_ctx_t * ctx);
+static void sink_write(worker_t * w, uint64_t ts, void * data, uint32_t len);
+static void sink_flush(sudoku_ctx_t * ctx);
+static void sink_destroy(sudoku_ctx_t * ctx);
+static void metrics_create(sudoku_ctx_t * ctx);
+static void metrics_destroy(sudoku_ctx_t * ctx);
+static void frontier_add(worker_t * w, board_t * b);
+static bool checkpoint_write(sudoku_ctx_t * ctx, job_t * job);
+static bool checkpoint_read(sudoku_ctx_t * ctx, job_t * job);
+static void frontier_alloc(sudoku_ctx_t * ctx, uint64_t n);
+static void * worker_thread(void * cx);
+static bool deque_push(worker_t * w, board_t * b);
+static task_t * deque_pop(worker_t * w);
+static task_t * deque_steal(worker_t * w);
+static bool frontier_claim(worker_t * w);
+static task_t * task_alloc(worker_t * w);
+static void task_free(worker_t * w, task_t * t);
+static void task_pool_destroy(worker_t * w);
+static void batch_chunk(worker_t * w, chunk_t * c);
+static void batch_latency(worker_t * w, chunk_t * c, uint64_t ns);
+static void batch_slowest_ids(sudoku_ctx_t * ctx);
+static void batch_solve_puzzle(worker_t * w, job_t * job);
+static bool async_claim(worker_t * w);
+static void generate_chunk(worker_t * w, chunk_t * c);
+static inline uint64_t generate_random(uint64_t * state);
+#if BOX_SIZE == 3
+static void cache_create(sudoku_ctx_t * ctx);
+static void cache_destroy(sudoku_ctx_t * ctx);
+static void cache_find_solutions(worker_t * w, job_t * job, board_t * b);
+#endif
+#ifdef VERIFY_SOLUTIONS
+static void verify_create(sudoku_ctx_t * ctx);
+static void verify_reset(sudoku_ctx_t * ctx);
+static void verify_destroy(sudoku_ctx_t * ctx);
+static void verify_solution(worker_t * w, puzzle_t * p);
+#endif
+static uint64_t microsec_timer(void);
+static uint64_t nanosec_timer(void);
+static char * numeric_str(uint64_t v, char * s);
+
+//
+// strategies
+//
+
+strategy_t strategy_tbl[MAX_STRATEGY] = {
+    { "naked",   NULL           },      // naked singles, performed by the kernel
+    { "hidden",  hidden_singles },
+    { "pairs",   naked_pairs    },
+    { "triples", naked_triples  },
+};
+
+// -----------------  CONTEXT  -------------------------------------
+
+void sudoku_defaults(sudoku_ctx_t * ctx)
+{
+    // init the context config to the defaults
+    memset(ctx, 0, sizeof(sudoku_ctx_t));
+    ctx->max_threads    = DEFAULT_MAX_THREADS;
+    ctx->print_interval = DEFAULT_PRINT_INTERVAL;
+    ctx->max_solutions  = DEFAULT_MAX_SOLUTIONS;
+    ctx->engine         = ENGINE_MRV;
+    ctx->heuristic      = HEURISTIC_MRV;
+    ctx->strategies     = DEFAULT_STRATEGIES;
+    ctx->input_format   = FORMAT_TEXT;
+    ctx->output_format  = FORMAT_TEXT;
+    ctx->output_order   = ORDER_ANY;
+    ctx->output_fd      = -1;
+    ctx->metrics_fd     = -1;
+    ctx->metrics_interval_ms = DEFAULT_METRICS_INTERVAL_MS;
+    ctx->checkpoint_interval = DEFAULT_CHECKPOINT_INTERVAL;
+}
+
+int sudoku_create(sudoku_ctx_t * ctx)
+{
+    pool_t * pool;
+
+    // initialize the dlx template, which is shared by all contexts
+    pthread_once(&initialize_once, initialize);
+
+    // verify the config, and select the propagation pipeline
+    ctx->error[0] = '\0';
+    if (ctx->max_threads == 0 || ctx->print_interval == 0 || ctx->metrics_interval_ms == 0 ||
+        ctx->engine >= MAX_ENGINE || ctx->heuristic >= MAX_HEURISTIC ||
+        ctx->kernel >= MAX_KERNEL || ctx->input_format >= MAX_FORMAT ||
+        ctx->output_format >= MAX_FORMAT || ctx->output_order >= MAX_ORDER ||
+        (ctx->checkpoint_file && ctx->checkpoint_interval == 0)) 
+    {
+        snprintf(ctx->error, sizeof(ctx->error), "config is invalid");
+        return -1;
+    }
+    if (BOX_SIZE != 3 && ctx->cache_memory) {
+        snprintf(ctx->error, sizeof(ctx->error), "cache is supported for 9x9 boards only");
+        return -1;
+    }
+    if (!pipeline_select(ctx, ctx->strategies)) {
+        return -1;
+    }
+    if (ctx->split_depth == 0) {
+        ctx->split_depth = (ctx->engine == ENGINE_DLX ? DEFAULT_SPLIT_DEPTH_DLX : DEFAULT_SPLIT_DEPTH_MRV);
+    }
+
+    // select the naked singles kernel, avx2 is used when the cpu supports it,
+    // for 9x9 boards
+#if defined(__x86_64__) && BOX_SIZE == 3
+    bool avx2 = __builtin_cpu_supports("avx2");
+#else
+    bool avx2 = false;
+#endif
+    if (ctx->kernel == KERNEL_AUTO) {
+        ctx->kernel = (avx2 ? KERNEL_AVX2 : KERNEL_SCALAR);
+    }
+    if (ctx->kernel == KERNEL_AVX2 && !avx2) {
+        snprintf(ctx->error, sizeof(ctx->error), "avx2 kernel is not supported by the cpu, or the board size");
+        return -1;
+    }
+
+    // allocate the pool, and create the worker threads
+    pool = calloc(1, sizeof(pool_t));
+    if (pool == NULL) {
+        printf("ERROR: failed to allocate pool\n");
+        exit(1);
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->run_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    pthread_mutex_init(&pool->async_mutex, NULL);
+    pthread_cond_init(&pool->async_cond, NULL);
+    pthread_mutex_init(&pool->sink_mutex, NULL);
+    pthread_cond_init(&pool->sink_cond, NULL);
+    pthread_cond_init(&pool->sink_flush_cond, NULL);
+    pool->async_fd = -1;
+#if defined(__x86_64__) && BOX_SIZE == 3
+    pool->naked_singles = (ctx->kernel == KERNEL_AVX2 ? naked_singles_avx2 : naked_singles_scalar);
+#else
+    pool->naked_singles = naked_singles_scalar;
+#endif
+    ctx->pool = pool;
+    pool->create_us = microsec_timer();
+    pool_create(ctx);
+    if (ctx->metrics_fd >= 0) {
+        metrics_create(ctx);
+    }
+#if BOX_SIZE == 3
+    if (ctx->cache_memory) {
+        cache_create(ctx);
+    }
+#endif
+#ifdef VERIFY_SOLUTIONS
+    verify_create(ctx);
+#endif
+
+    return 0;
+}
+
+void sudoku_destroy(sudoku_ctx_t * ctx)
+{
+    pool_t * pool = ctx->pool;
+    uint32_t i;
+
+    // stop serving async requests, terminate the metrics and worker threads, 
+    // and free the pool
+    sudoku_async_stop(ctx);
+    if (ctx->metrics_fd >= 0) {
+        metrics_destroy(ctx);
+    }
+    if (pool->workers[0].sink) {
+        sink_destroy(ctx);
+    }
+    pool_destroy(ctx);
+#if BOX_SIZE == 3
+    if (pool->cache) {
+        cache_destroy(ctx);
+    }
+#endif
+#ifdef VERIFY_SOLUTIONS
+    verify_destroy(ctx);
+#endif
+    if (pool->batch_chunks) {
+        for (i = 0; i < BATCH_WINDOW_CHUNKS + 1; i++) {
+            free(pool->batch_chunks[i].out);
+        }
+        free(pool->batch_chunks);
+    }
+    for (i = 0; i < ctx->max_threads; i++) {
+        task_pool_destroy(&pool->workers[i]);
+    }
+    free(pool->frontier);
+    free(pool->workers);
+    free(pool->worker_cpu);
+    free(pool->worker_node);
+    free(pool->async_sq);
+    free(pool->async_cq);
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->run_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_mutex_destroy(&pool->async_mutex);
+    pthread_cond_destroy(&pool->async_cond);
+    pthread_mutex_destroy(&pool->sink_mutex);
+    pthread_cond_destroy(&pool->sink_cond);
+    pthread_cond_destroy(&pool->sink_flush_cond);
+    free(pool);
+    ctx->pool = NULL;
+}
+
+static void job_init(sudoku_ctx_t * ctx, job_t * job, puzzle_t * puzzle, bool count)
+{
+    // init the job of a solve
+    memset(job, 0, sizeof(job_t));
+    job->puzzle     = *puzzle;
+    job->print      = !count && (ctx->output_fd >= 0 || ctx->solution_cb != NULL);
+    job->count      = count;
+    job->split      = true;
+    job->checkpoint = (ctx->checkpoint_file != NULL);
+    job->max_solutions = ctx->max_solutions;
+}
+
+static int64_t solve(sudoku_ctx_t * ctx, job_t * job, puzzle_t * solution)
+{
+    pool_t * pool = ctx->pool;
+    board_t  b;
+    uint32_t i;
+    bool     ok = true;
+
+    // a puzzle which uses a value more than once in a unit has no solution
+    if (!board_init(&b, &job->puzzle)) {
+        return 0;
+    }
+    for (i = 0; i < ctx->max_threads; i++) {
+        job->start_nodes += pool->workers[i].num_nodes;
+    }
+    job->start_us = ctx->stats.duration_us;
+
+    // find solutions, using the pool of worker threads; the puzzle 
+    // is the initial branch state, it is given to worker 0, whose task 
+    // pool can be used here because the workers are waiting for the run;
+    // a resumed, or symmetry reduced, job instead starts with the branch
+    // states of the pool's frontier
+    if (job->print && ctx->output_fd >= 0) {
+        if (pool->workers[0].sink == NULL) {
+            sink_create(ctx);
+        }
+        pool->sink_next_ts = (job->num_solutions == 0 ? 1 :
+                              (job->num_solutions / ctx->print_interval + 1) * ctx->print_interval);
+        pool->sink_active = true;
+    }
+#ifdef VERIFY_SOLUTIONS
+    verify_reset(ctx);
+#endif
+    pool->deque_job = job;
+    if (!job->from_frontier) {
+        deque_push(&pool->workers[0], &b);
+    }
+
+    // when the job is checkpointed, each checkpoint_interval the run is 
+    // stopped, with the pending branch states saved in the worker frontiers;
+    // the checkpoint is written, and a run is started from the frontier;
+    // a checkpoint is also written when the solve is cancelled or completes;
+    // when a checkpoint can not be written the solve is stopped, and the 
+    // error is returned
+    while (true) {
+        pool_run(ctx, job->checkpoint ? ctx->checkpoint_interval : 0);
+        if (!job->checkpoint) {
+            break;
+        }
+        if (!checkpoint_write(ctx, job)) {
+            ok = false;
+            break;
+        }
+        if (ctx->cancel || pool->max_frontier == 0) {
+            break;
+        }
+        pool->checkpoint = false;
+    }
+    pool->checkpoint = false;
+    pool->max_frontier = pool->frontier_next = 0;
+    pool->deque_job = NULL;
+    if (pool->sink_active) {
+        sink_flush(ctx);
+        pool->sink_active = false;
+    }
+
+    // in count only mode the total may exceed max_solutions, limit it
+    if (job->max_solutions != MAX_SOLUTIONS_INFINITE && job->num_solutions > job->max_solutions) {
+        job->num_solutions = job->max_solutions;
+    }
+
+    // return the number of solutions, and the first solution; the stats 
+    // of a resumed job include those from before the checkpoint
+    if (solution && job->num_solutions > 0 && !job->count) {
+        *solution = job->solution;
+    }
+    ctx->stats.total_solutions += job->num_solutions;
+    ctx->stats.duration_us += job->prior_us;
+    pool->prior_nodes += job->prior_nodes;
+    stats_update(ctx);
+    return (ok ? job->num_solutions : -1);
+}
+
+int64_t sudoku_solve_one(sudoku_ctx_t * ctx, puzzle_t * puzzle, puzzle_t * solution)
+{
+    job_t job;
+
+    job_init(ctx, &job, puzzle, false);
+    return solve(ctx, &job, solution);
+}
+
+int64_t sudoku_count(sudoku_ctx_t * ctx, puzzle_t * puzzle)
+{
+    job_t job;
+
+    job_init(ctx, &job, puzzle, true);
+    return solve(ctx, &job, NULL);
+}
+
+int sudoku_unique(sudoku_ctx_t * ctx, puzzle_t * puzzle, puzzle_t * solution)
+{
+    pool_t   * pool = ctx->pool;
+    worker_t * w = &pool->workers[0];
+    uint64_t   start_us;
+    job_t      job;
+    board_t    b;
+
+    // init the job, the search stops when the second solution is found; 
+    // nothing is output, and the job is not checkpointed
+    job_init(ctx, &job, puzzle, false);
+    job.max_solutions = 2;
+    job.print         = false;
+    job.checkpoint    = false;
+    if (!board_init(&b, puzzle)) {
+        return SUDOKU_UNIQUE_NONE;
+    }
+#ifdef VERIFY_SOLUTIONS
+    verify_reset(ctx);
+#endif
+
+    // find up to 2 solutions; the solution count is checked against the 
+    // limit at each node, so when the second solution is found all the
+    // workers stop; with one thread the search is run by the calling 
+    // thread, using worker 0 which is waiting for a run, so there is no 
+    // wakeup of the worker thread
+    if (ctx->max_threads == 1) {
+        start_us = microsec_timer();
+        w->num_tasks++;
+        w->job = &job;
+        run_task(w, &b);
+        ctx->stats.duration_us += microsec_timer() - start_us;
+    } else {
+        pool->deque_job = &job;
+        deque_push(w, &b);
+        pool_run(ctx, 0);
+        pool->deque_job = NULL;
+    }
+
+    // return the result, and the solution when it is unique
+    ctx->stats.total_solutions += job.num_solutions;
+    stats_update(ctx);
+    if (job.num_solutions == 1 && solution) {
+        *solution = job.solution;
+    }
+    return (job.num_solutions == 0 ? SUDOKU_UNIQUE_NONE :
+            job.num_solutions == 1 ? SUDOKU_UNIQUE_ONE : SUDOKU_UNIQUE_MULTIPLE);
+}
+
+int64_t sudoku_resume(sudoku_ctx_t * ctx, bool count, puzzle_t * puzzle, puzzle_t * solution)
+{
+    job_t job;
+    int64_t n;
+
+    // read the checkpoint, its job and frontier, and continue the solve
+    ctx->error[0] = '\0';
+    if (ctx->checkpoint_file == NULL || !checkpoint_read(ctx, &job)) {
+        if (ctx->error[0] == '\0') {
+            snprintf(ctx->error, sizeof(ctx->error), "checkpoint file is not set");
+        }
+        return -1;
+    }
+    job.print = !count && (ctx->output_fd >= 0 || ctx->solution_cb != NULL);
+    job.count = count;
+    n = solve(ctx, &job, solution);
+    if (puzzle) {
+        *puzzle = job.puzzle;
+    }
+    return n;
+}
+
+char * sudoku_strategy_name(uint32_t strategy)
+{
+    return (strategy < MAX_STRATEGY ? strategy_tbl[strategy].name : NULL);
+}
+
+static void stats_update(sudoku_ctx_t * ctx)
+{
+    sudoku_stats_t * st = &ctx->stats;
+    worker_t       * w;
+    uint32_t         i, j, k;
+
+    // sum the per worker stats, these are for all the solves of the context
+    st->num_tasks = st->num_steals = st->num_remote_steals = st->max_task_size = 0;
+    st->num_nodes = ctx->pool->prior_nodes;
+    st->cache_hits = st->cache_misses = st->num_restarts = 0;
+    memset(st->strategy_stats, 0, sizeof(st->strategy_stats));
+    memset(st->heuristic_nodes, 0, sizeof(st->heuristic_nodes));
+    memset(st->task_size_hist, 0, sizeof(st->task_size_hist));
+    memset(st->latency_hist, 0, sizeof(st->latency_hist));
+    memset(st->slowest, 0, sizeof(st->slowest));
+    for (i = 0; i < ctx->max_threads; i++) {
+        w = &ctx->pool->workers[i];
+        st->num_tasks  += w->num_tasks;
+        st->num_steals += w->num_steals;
+        st->num_remote_steals += w->num_remote_steals;
+        st->num_nodes  += w->num_nodes;
+        st->cache_hits   += w->cache_hits;
+        st->cache_misses += w->cache_misses;
+        st->num_restarts += w->num_restarts;
+        for (j = 0; j < MAX_HEURISTIC; j++) {
+            st->heuristic_nodes[j] += w->heuristic_nodes[j];
+        }
+        for (j = 0; j < MAX_STRATEGY; j++) {
+            st->strategy_stats[j].calls          += w->strategy_stats[j].calls;
+            st->strategy_stats[j].changes        += w->strategy_stats[j].changes;
+            st->strategy_stats[j].contradictions += w->strategy_stats[j].contradictions;
+            st->strategy_stats[j].ns             += w->strategy_stats[j].ns;
+        }
+        for (j = 0; j < MAX_TASK_SIZE_HIST; j++) {
+            st->task_size_hist[j] += w->task_size_hist[j];
+        }
+        if (w->max_task_size > st->max_task_size) {
+            st->max_task_size = w->max_task_size;
+        }
+        for (j = 0; j < MAX_LATENCY_HIST; j++) {
+            st->latency_hist[j] += w->latency_hist[j];
+        }
+
+        // merge the worker's slowest puzzles, keeping st->slowest in 
+        // order, slowest first
+        for (j = 0; j < MAX_SLOWEST; j++) {
+            slowest_t * e = &w->slowest[j];
+            if (e->ns == 0 || e->chunk != NULL || e->ns <= st->slowest[MAX_SLOWEST-1].ns) {
+                continue;
+            }
+            for (k = MAX_SLOWEST-1; k > 0 && st->slowest[k-1].ns < e->ns; k--) {
+                st->slowest[k] = st->slowest[k-1];
+            }
+            st->slowest[k].id = e->id;
+            st->slowest[k].ns = e->ns;
+        }
+    }
+}
+
+static void initialize(void)
+{
+    // init the dlx matrix template
+    dlx_init();
+}
+
+// -----------------  BOARD  ---------------------------------------
+
+// The board is the puzzle along with bitmasks of the values used in each
+// unit (row, col, and grid). The bitmasks are updated incrementally as values 
+// are set, so the possible values of a location are found with three ORs, rather
+// than by examining the location's siblings, 20 of them for 9x9.
+//
+// When the board has a trail, the changes made by board_set and board_exclude
+// are logged, and board_undo reverts the board to an earlier point of the trail.
+
+static bool board_init(board_t * b, puzzle_t * p)
+{
+    uint32_t locidx, unit, i;
+    mask_t   bit;
+
+    // init the board from the puzzle; return false if a value is 
+    // used more than once in a unit
+    memset(b, 0, sizeof(board_t));
+    b->p = *p;
+    for (locidx = 0; locidx < MAX_LOC; locidx++) {
+        if (p->value[locidx] == NO_VALUE) {
+            continue;
+        }
+        bit = (1 << p->value[locidx]);
+        for (i = 0; i < 3; i++) {
+            unit = units_of[locidx][i];
+            if (b->used[unit] & bit) {
+                return false;
+            }
+            b->used[unit] |= bit;
+        }
+    }
+    return true;
+}
+
+static inline void board_log(board_t * b, uint32_t locidx, bool set)
+{
+    trail_ent_t * e = &b->trail->ent[b->trail->max_ent++];
+
+    // log a change to the board in its trail
+    assert(b->trail->max_ent <= MAX_TRAIL);
+    e->locidx   = locidx;
+    e->set      = set;
+    e->excluded = b->excluded[locidx];
+}
+
+static inline void board_set(board_t * b, uint32_t locidx, uint8_t value)
+{
+    if (b->trail) {
+        board_log(b, locidx, true);
+    }
+    b->p.value[locidx] = value;
+    b->p.num_no_value--;
+    b->used[units_of[locidx][0]] |= (1 << value);
+    b->used[units_of[locidx][1]] |= (1 << value);
+    b->used[units_of[locidx][2]] |= (1 << value);
+}
+
+static inline void board_exclude(board_t * b, uint32_t locidx, uint32_t values)
+{
+    if (b->trail) {
+        board_log(b, locidx, false);
+    }
+    b->excluded[locidx] |= values;
+}
+
+static void board_undo(board_t * b, uint32_t trail_pos)
+{
+    trail_ent_t * e;
+    mask_t bit;
+
+    // undo the changes logged in the board's trail after trail_pos, most recent first
+    while (b->trail->max_ent > trail_pos) {
+        e = &b->trail->ent[--b->trail->max_ent];
+        if (e->set) {
+            bit = (1 << b->p.value[e->locidx]);
+            b->used[units_of[e->locidx][0]] &= ~bit;
+            b->used[units_of[e->locidx][1]] &= ~bit;
+            b->used[units_of[e->locidx][2]] &= ~bit;
+            b->p.value[e->locidx] = NO_VALUE;
+            b->p.num_no_value++;
+        } else {
+            b->excluded[e->locidx] = e->excluded;
+        }
+    }
+}
+
+static inline void possible_values(board_t * b, uint32_t locidx, uint32_t * pv_arg, uint32_t * num_pv_arg)
+{
+    uint32_t pv;
+
+    // determine the possible values that a location can have;
+    // this routine returns 
+    // - pv_arg: bitmask of the possilbe values
+    // - num_pv_arg: number of possible values, this equals the number of bits
+    //   that are set in pv_arg
+
+    pv = ~(b->used[units_of[locidx][0]] | 
+           b->used[units_of[locidx][1]] | 
+           b->used[units_of[locidx][2]] |
+           b->excluded[locidx]) & ALL_VALUES;
+
+    *pv_arg = pv;
+    *num_pv_arg = __builtin_popcount(pv);
+}
+
+// -----------------  FIND SOLUTIONS  ------------------------------
+
+// The search of each engine stops when the solve is cancelled, or a checkpoint
+// is requested. When the job is checkpointed the branch states not yet
+// searched are saved in the worker's frontier, see frontier_add; these are
+// the branch states reached as the search unwinds, and those of the tasks 
+// still on the deques, which are run and stop at once.
+
+static inline bool search_stop(worker_t * w)
+{
+    return w->ctx->cancel || w->pool->checkpoint;
+}
+
+static void find_solutions(worker_t * w, board_t b)
+{
+    sudoku_ctx_t * ctx = w->ctx;
+    uint32_t   best_num_pv, best_locidx=-1, best_pv=-1;
+    uint8_t    trial_val, first_trial_val;
+    bool       split;
+    int32_t    rc;
+
+    // if interrupted, or checkpointing, then save the branch state
+    // in the frontier, and return
+    if (search_stop(w)) {
+        frontier_add(w, &b);
+        return;
+    }
+
+    // if the number of solutions found is at or exceeds the limit then return
+    if (w->job->max_solutions != MAX_SOLUTIONS_INFINITE && w->job->num_solutions >= w->job->max_solutions) {
+        return;
+    }
+
+    // if the restart heuristic's node limit is reached then return
+    if (w->node_limit && w->num_nodes >= w->node_limit) {
+        w->node_limit_hit = true;
+        return;
+    }
+
+    // keep track of the number of branch states examined
+    w->num_nodes++;
+
+    // propagate, and if there is no solution then return
+    rc = propagate(w, &b, &best_locidx, &best_pv, &best_num_pv);
+    if (rc < 0) {
+        return;
+    }
+
+    // if found a solution then record it, and return
+    if (rc == 0) {
+        record_solution(w, &b.p);
+        return;
+    }
+
+    // assert that the above code has set best_num_pv, best_locidx, and best_pv
+    assert(best_num_pv >= 2 && best_num_pv <= MAX_VALUE);
+    assert(best_pv != -1 && best_locidx != -1);
+
+    // using the locidx with the least number of possible values, set that
+    // location to each of the possible values that the location can have:
+    // - the branch states for all but the first trial value are pushed on this 
+    //   worker's deque, where they can be stolen by idle workers; if the deque 
+    //   is full (or there is just one worker, or the job is not split, or the
+    //   branch states are below the split depth) then recursively call 
+    //   find_solutions
+    // - the first trial value is handled by a recursive call to find_solutions
+    //
+    // with the other branching heuristics the location, and the order its
+    // values are tried in, are selected by branch_select; the values are
+    // tried in that order, and when splitting the branch states of all but
+    // the first are pushed on the deque, the last first, so this worker pops
+    // them in order
+    split = (ctx->max_threads > 1 && w->job->split && b.depth < ctx->split_depth);
+    if (ctx->heuristic != HEURISTIC_MRV) {
+        uint8_t  order[MAX_VALUE];
+        uint32_t n, i, pushed = 0;
+
+        n = branch_select(w, &b, &best_locidx, &best_pv, best_num_pv, order);
+        for (i = n - 1; split && i > 0; i--) {
+            board_t child = b;
+            board_set(&child, best_locidx, order[i]);
+            child.depth++;
+            if (deque_push(w, &child)) {
+                pushed |= (1 << i);
+            }
+        }
+        for (i = 0; i < n; i++) {
+            if (pushed & (1 << i)) {
+                continue;
+            }
+            board_t child = b;
+            board_set(&child, best_locidx, order[i]);
+            child.depth++;
+            find_solutions(w,child);
+        }
+        return;
+    }
+    first_trial_val = 0;
+    for (trial_val = 1; trial_val <= MAX_VALUE; trial_val++) { 
+        if (best_pv & (1 << trial_val)) {
+            if (first_trial_val == 0) {
+                first_trial_val = trial_val;
+                continue;
+            }
+            board_t child = b;
+            board_set(&child, best_locidx, trial_val);
+            child.depth++;
+            if (!split || !deque_push(w, &child)) {
+                find_solutions(w,child);
+            }
+        }
+    }
+    board_set(&b, best_locidx, first_trial_val);
+    b.depth++;
+    find_solutions(w,b);
+}
+
+static int32_t propagate(worker_t * w, board_t * b, uint32_t * best_locidx, uint32_t * best_pv, uint32_t * best_num_pv)
+{
+    sudoku_ctx_t * ctx = w->ctx;
+    bool       strategy_made_changes;
+    int32_t    changes;
+    uint32_t   i;
+
+    // this routine propagates the values of the board by determining
+    // the possible values (pv) for all blank locations; if there
+    // is just one possible value then it is filled in; this 
+    // process repeats until either:
+    // - a location has 0 possible values, in which case the 
+    //   puzzle has no solution, or
+    // - there are no more locations with 1 possible value
+    //
+    // a pass over the blank locations is made by the naked singles kernel,
+    // selected by sudoku_create: the scalar kernel does one location at a
+    // time, the avx2 kernel 16 at a time
+    //
+    // when there are no more locations with 1 possible value the other
+    // strategies in the propagation pipeline are run, in order; if a 
+    // strategy sets or eliminates values then the naked singles are
+    // searched for again 
+    //
+    // do
+    //   do
+    //     for all blank locations
+    //       determine possible values
+    //       if number of possible values is zero
+    //         return because there is no solution
+    //       else if number of possible values is 1 then
+    //         set the value
+    //       else
+    //         keep track of the location with the least number of
+    //          possible values; this info is returned to the caller,
+    //          which branches on that location
+    //       endif
+    //     endfor
+    //   while one or more values have been set
+    //   for the other strategies in the pipeline
+    //     run the strategy
+    //     if the strategy found a contradiction then
+    //       return because there is no solution
+    //     else if the strategy made changes then
+    //       break
+    //     endif
+    //   endfor
+    // while a strategy made changes
+    do {
+        strategy_stats_t * ss = &w->strategy_stats[STRATEGY_NAKED_SINGLES];
+        uint64_t start_ns = (ctx->strategy_timing ? nanosec_timer() : 0);
+        do {
+            ss->calls++;
+            changes = w->pool->naked_singles(b, best_locidx, best_pv, best_num_pv);
+            if (changes < 0) {
+                ss->contradictions++;
+                if (ctx->strategy_timing) ss->ns += nanosec_timer() - start_ns;
+                return -1;
+            }
+            ss->changes += changes;
+        } while (changes > 0);
+        if (ctx->strategy_timing) ss->ns += nanosec_timer() - start_ns;
+
+        strategy_made_changes = false;
+        if (b->p.num_no_value == 0) {
+            break;
+        }
+        for (i = 1; i < ctx->max_pipeline; i++) {
+            ss = &w->strategy_stats[ctx->pipeline[i]];
+            start_ns = (ctx->strategy_timing ? nanosec_timer() : 0);
+            ss->calls++;
+            changes = strategy_tbl[ctx->pipeline[i]].proc(b);
+            if (ctx->strategy_timing) ss->ns += nanosec_timer() - start_ns;
+            if (changes < 0) {
+                ss->contradictions++;
+                return -1;
+            } else if (changes > 0) {
+                ss->changes += changes;
+                strategy_made_changes = true;
+                break;
+            }
+        }
+    } while (strategy_made_changes);
+
+    // return 0 if solved, else 1; when not solved best_locidx, best_pv, and 
+    // best_num_pv are the location with the least number of possible values
+    return (b->p.num_no_value == 0 ? 0 : 1);
+}
+
+// In count only mode a solution is counted in the worker's counter, which
+// is in its own cache line, and the counters are added to job->num_solutions
+// when a task completes. When there is a max_solutions limit the worker 
+// first reserves a batch of solutions from job->num_reserved, so that the
+// limit is honored without an atomic operation per solution:
+// - the batch size is reduced as the limit is approached, so that the 
+//   solutions reserved but not found by one worker rarely hold back others
+// - the counter is added to job->num_solutions when its reservation is used,
+//   and the unused reservation is returned when the task completes
+// - a solution found when nothing can be reserved is added directly to
+//   job->num_solutions; so the search continues until job->num_solutions 
+//   reaches the limit, and the total is then limited to max_solutions
+
+static bool count_reserve(worker_t * w)
+{
+    sudoku_ctx_t * ctx = w->ctx;
+    job_t  * job = w->job;
+    uint64_t reserved, batch;
+
+    do {
+        reserved = job->num_reserved;
+        if (reserved >= job->max_solutions) {
+            return false;
+        }
+        batch = (job->max_solutions - reserved) / (2 * ctx->max_threads);
+        batch = (batch < 1 ? 1 : batch > COUNT_RESERVE_BATCH ? COUNT_RESERVE_BATCH : batch);
+    } while (!__sync_bool_compare_and_swap(&job->num_reserved, reserved, reserved + batch));
+
+    w->counter.reserved = batch;
+    return true;
+}
+
+static void count_solution(worker_t * w)
+{
+    counter_t * c = &w->counter;
+
+    if (w->job->max_solutions == MAX_SOLUTIONS_INFINITE) {
+        c->count++;
+        return;
+    }
+
+    if (c->reserved == 0 && !count_reserve(w)) {
+        __sync_add_and_fetch(&w->job->num_solutions, 1);
+        return;
+    }
+    c->count++;
+    if (--c->reserved == 0) {
+        __sync_add_and_fetch(&w->job->num_solutions, c->count);
+        c->count = 0;
+    }
+}
+
+static void count_flush(worker_t * w)
+{
+    counter_t * c = &w->counter;
+
+    // add the worker's count to the job, and return its unused reservation
+    if (c->count) {
+        __sync_add_and_fetch(&w->job->num_solutions, c->count);
+        c->count = 0;
+    }
+    if (c->reserved) {
+        __sync_sub_and_fetch(&w->job->num_reserved, c->reserved);
+        c->reserved = 0;
+    }
+}
+
+static void record_solution(worker_t * w, puzzle_t * p)
+{
+    sudoku_ctx_t * ctx = w->ctx;
+    job_t  * job = w->job;
+    uint64_t ts;
+
+#ifdef VERIFY_SOLUTIONS
+    // verify the solution: if the solution is incorrect then this
+    // is a bug in this program; and the verify_solution routine will
+    // print an error message and exit the program
+    verify_solution(w, p);
+#endif
+
+    // in count only mode, count the solution in this worker's counter
+    w->num_solutions++;
+    if (job->count) {
+        count_solution(w);
+        return;
+    }
+
+    // keep track of the number of solutions found for the job
+    ts = __sync_add_and_fetch(&job->num_solutions,1);
+    if (job->max_solutions != MAX_SOLUTIONS_INFINITE && ts > job->max_solutions) {
+        __sync_sub_and_fetch(&job->num_solutions,1);
+        return;
+    }
+
+    // save the first solution
+    if (ts == 1) {
+        job->solution = *p;
+    }
+
+    // output the first solution and 
+    // output subsequent solutions at the print_interval, to the
+    // output_fd and the solution callback
+    if (job->print && ((ts % ctx->print_interval) == 0 || ts == 1)) {
+        if (w->pool->sink_active) {
+            char s[SUDOKU_MAX_FORMAT];
+            if (ctx->output_format == FORMAT_PACKED) {
+                sudoku_pack(p, 0, (uint8_t*)s);
+                sink_write(w, ts, s, PACKED_SIZE);
+            } else {
+                sink_write(w, ts, s, sudoku_format_puzzle(ctx, p, ts, s));
+            }
+        }
+        if (ctx->solution_cb) {
+            ctx->solution_cb(ctx, ts, p);
+        }
+    }
+}
+
+// -----------------  BRANCHING HEURISTICS  ------------------------
+
+// The mrv and iter engines branch on the location found by the naked singles
+// kernel, the first with the fewest possible values, and try its values in
+// numeric order; this is the mrv heuristic. The others are:
+// - degree: of the locations with the fewest possible values, the one with
+//   the most blank locations in its units, which constrains the most others
+// - lcv: as degree, and the values are tried least constraining first; that 
+//   is, the value possible in the fewest of the blank locations in the 
+//   branch location's units
+// - restart: as lcv; a search for the first solution which is not split is
+//   stopped at RESTART_NODES nodes, and restarted with twice the limit, with
+//   the ties of the location and value order broken at random; so a search
+//   that is stuck below a poor early branch decision is tried again with 
+//   other decisions, and since the limit grows the search still completes
+//   when the puzzle has no solution
+// The random state is seeded from the job's id, and the restart number, so
+// the search is the same for any number of threads.
+//
+// The nodes examined with each heuristic are in the stats, so heuristics
+// can be compared on a corpus.
+
+static uint32_t branch_select(worker_t * w, board_t * b, uint32_t * best_locidx, uint32_t * best_pv, uint32_t best_num_pv, uint8_t * order)
+{
+    uint32_t locidx, pv, num_pv, degree, best_degree, num_best, unit, other, i, j, k, n;
+    uint32_t key[MAX_VALUE], constrains[MAX_VALUE + 1];
+
+    // select the branch location: of the locations with best_num_pv possible
+    // values, the one with the most blank locations in its units; the number
+    // of blank locations in a unit is MAX_VALUE less the values used
+    best_degree = 0;
+    num_best = 0;
+    for (locidx = 0; locidx < MAX_LOC; locidx++) {
+        if (b->p.value[locidx] != NO_VALUE) {
+            continue;
+        }
+        possible_values(b, locidx, &pv, &num_pv);
+        if (num_pv != best_num_pv) {
+            continue;
+        }
+        degree = 3 * MAX_VALUE - __builtin_popcount(b->used[units_of[locidx][0]]) -
+                                 __builtin_popcount(b->used[units_of[locidx][1]]) -
+                                 __builtin_popcount(b->used[units_of[locidx][2]]);
+        if (degree > best_degree) {
+            num_best = 1;
+        } else if (degree < best_degree || !w->randomize || generate_random(&w->rng) % ++num_best != 0) {
+            continue;
+        }
+        best_degree  = degree;
+        *best_locidx = locidx;
+        *best_pv     = pv;
+    }
+
+    // the values, in numeric order
+    for (n = 0, pv = *best_pv; pv; pv &= pv - 1) {
+        order[n++] = __builtin_ctz(pv);
+    }
+    if (w->ctx->heuristic == HEURISTIC_DEGREE) {
+        return n;
+    }
+
+    // count, for each value, the blank locations in the branch location's
+    // units that it is possible in; a location in its grid and also in its
+    // row or col is counted once
+    memset(constrains, 0, sizeof(constrains));
+    for (i = 0; i < 3; i++) {
+        unit = units_of[*best_locidx][i];
+        for (j = 0; j < MAX_VALUE; j++) {
+            other = unit_locs[unit][j];
+            if (other == *best_locidx || b->p.value[other] != NO_VALUE ||
+                (i == 2 && (ROW(other) == ROW(*best_locidx) || COL(other) == COL(*best_locidx))))
+            {
+                continue;
+            }
+            possible_values(b, other, &pv, &num_pv);
+            for (pv &= *best_pv; pv; pv &= pv - 1) {
+                constrains[__builtin_ctz(pv)]++;
+            }
+        }
+    }
+
+    // sort the values, least constraining first; ties are in numeric order,
+    // or at random
+    for (i = 0; i < n; i++) {
+        key[i] = (constrains[order[i]] << 16) | (w->randomize ? generate_random(&w->rng) & 0xff00 : 0) | order[i];
+    }
+    for (i = 1; i < n; i++) {
+        for (k = key[i], j = i; j > 0 && key[j-1] > k; j--) {
+            key[j] = key[j-1];
+        }
+        key[j] = k;
+    }
+    for (i = 0; i < n; i++) {
+        order[i] = key[i] & 0xff;
+    }
+    return n;
+}
+
+static void restart_find_solutions(worker_t * w, board_t * b)
+{
+    sudoku_ctx_t * ctx = w->ctx;
+    uint64_t limit = RESTART_NODES;
+    uint32_t restart;
+
+    // search with a node limit, the first search is as the lcv heuristic; 
+    // if the limit is reached without finding the solution then search 
+    // again, with twice the limit and the ties broken at random
+    for (restart = 0; ; restart++) {
+        w->node_limit     = w->num_nodes + limit;
+        w->node_limit_hit = false;
+        if (ctx->engine == ENGINE_ITER) {
+            iter_find_solutions(w, b);
+        } else {
+            find_solutions(w, *b);
+        }
+        if (!w->node_limit_hit || w->job->num_solutions > 0 || search_stop(w)) {
+            break;
+        }
+        w->num_restarts++;
+        w->randomize = true;
+        w->rng = (w->job->id << 20) + restart;
+        limit *= 2;
+    }
+    w->node_limit = 0;
+    w->randomize  = false;
+}
+
+// -----------------  ITER ENGINE  ---------------------------------
+
+// The iter engine is the mrv search done iteratively. Rather than copying
+// the board for each branch state, as find_solutions does, a task searches 
+// with one board, in the worker's iter_t, which is changed in place:
+// - the board's changes are logged in the trail
+// - a branch decision pushes a frame on the explicit stack, with the trail 
+//   position and the values of the branch location not yet tried
+// - to try the next value of a branch location the board is reverted to 
+//   the frame's trail position, with board_undo
+// The propagation, branch location, value order, and splitting down to the
+// split depth are the same as find_solutions; the branch states pushed on the
+// worker's deque are copies of the board, without the trail. When checkpointing, the
+// branch states of the values not yet tried are made by setting each value
+// and undoing it.
+
+static void iter_find_solutions(worker_t * w, board_t * start)
+{
+    sudoku_ctx_t * ctx = w->ctx;
+    iter_t   * it;
+    board_t  * b;
+    frame_t  * f;
+    uint32_t   best_num_pv, best_locidx=-1, best_pv=-1;
+    uint32_t   sp, value, start_depth;
+    int32_t    rc;
+
+    // allocate the worker's iter
+    if (w->iter == NULL) {
+        w->iter = malloc(sizeof(iter_t));
+        if (w->iter == NULL) {
+            printf("ERROR: failed to allocate iter\n");
+            exit(1);
+        }
+    }
+    it = w->iter;
+
+    // init the board from the branch state, with an empty trail and stack
+    it->b = *start;
+    it->b.trail = &it->trail;
+    it->trail.max_ent = 0;
+    b = &it->b;
+    start_depth = b->depth;
+    sp = 0;
+
+    // search
+    //
+    // loop
+    //   examine the board: return if interrupted or at the solutions limit,
+    //    propagate, and either record the solution or push a frame for the
+    //    branch location
+    //   loop
+    //     if the stack is empty then return
+    //     undo the changes since the top frame's branch decision
+    //     if the frame has a value not yet tried then
+    //       set it, and break so the board is examined
+    //     endif
+    //     pop the frame
+    //   endloop
+    // endloop
+    while (true) {
+        if (search_stop(w)) {
+            // save the board, and the branch states of the values not
+            // yet tried, in the frontier
+            frontier_add(w, b);
+            while (w->job->checkpoint && sp > 0) {
+                f = &it->stack[--sp];
+                board_undo(b, f->trail_pos);
+                while (f->pv) {
+                    value = __builtin_ctz(f->pv);
+                    f->pv &= f->pv - 1;
+                    board_set(b, f->locidx, value);
+                    frontier_add(w, b);
+                    board_undo(b, f->trail_pos);
+                }
+            }
+            return;
+        }
+        if (w->job->max_solutions != MAX_SOLUTIONS_INFINITE && w->job->num_solutions >= w->job->max_solutions) {
+            return;
+        }
+        if (w->node_limit && w->num_nodes >= w->node_limit) {
+            w->node_limit_hit = true;
+            return;
+        }
+        w->num_nodes++;
+
+        rc = propagate(w, b, &best_locidx, &best_pv, &best_num_pv);
+        if (rc == 0) {
+            record_solution(w, &b->p);
+        } else if (rc > 0) {
+            assert(best_num_pv >= 2 && best_num_pv <= MAX_VALUE);
+            assert(best_pv != -1 && best_locidx != -1);
+            assert(sp < MAX_LOC);
+
+            // push a frame for the branch location; when splitting, the 
+            // branch states for all but the first value are pushed on this
+            // worker's deque, where they can be stolen by idle workers
+            f = &it->stack[sp++];
+            f->num_order = 0;
+            if (ctx->heuristic != HEURISTIC_MRV) {
+                f->num_order = branch_select(w, b, &best_locidx, &best_pv, best_num_pv, f->order);
+                f->next = 0;
+            }
+            f->trail_pos = it->trail.max_ent;
+            f->locidx    = best_locidx;
+            f->pv        = best_pv;
+            if (f->num_order && ctx->max_threads > 1 && w->job->split && b->depth < ctx->split_depth) {
+                uint32_t i;
+                for (i = f->num_order - 1; i > 0; i--) {
+                    value = f->order[i];
+                    board_t child = *b;
+                    child.trail = NULL;
+                    board_set(&child, best_locidx, value);
+                    child.depth++;
+                    if (!deque_push(w, &child)) {
+                        break;
+                    }
+                    f->pv &= ~(1 << value);
+                }
+            } else if (ctx->max_threads > 1 && w->job->split && b->depth < ctx->split_depth) {
+                uint32_t pv = best_pv & (best_pv - 1);
+                while (pv) {
+                    value = __builtin_ctz(pv);
+                    pv &= pv - 1;
+                    board_t child = *b;
+                    child.trail = NULL;
+                    board_set(&child, best_locidx, value);
+                    child.depth++;
+                    if (!deque_push(w, &child)) {
+                        break;
+                    }
+                    f->pv &= ~(1 << value);
+                }
+            }
+        }
+
+        // backtrack to the next value to try
+        while (true) {
+            if (sp == 0) {
+                return;
+            }
+            f = &it->stack[sp-1];
+            board_undo(b, f->trail_pos);
+            if (f->pv) {
+                if (f->num_order == 0) {
+                    value = __builtin_ctz(f->pv);
+                } else {
+                    while (!(f->pv & (1 << f->order[f->next]))) {
+                        f->next++;
+                    }
+                    value = f->order[f->next++];
+                }
+                f->pv &= ~(1 << value);
+                board_set(b, f->locidx, value);
+                b->depth = start_depth + sp;
+                break;
+            }
+            sp--;
+        }
+    }
+}
+
+// -----------------  DLX ENGINE  ----------------------------------
+
+// Knuth's dancing links implementation of algorithm x. Each of the DLX_MAX_ROW
+// rows of the exact cover matrix, 729 for 9x9, is a value at a location, and it
+// has a node in 4 of the DLX_MAX_COL columns, 324 for 9x9: 
+// - the location has a value
+// - the value is used in the location's row
+// - the value is used in the location's col
+// - the value is used in the location's grid
+//
+// The matrix is built once, in dlx_template. A task copies the template
+// into the worker's dlx and selects the rows of the values already set on
+// the board. Search decisions down to the split depth are made into boards
+// and pushed on the worker's deque, so they can be stolen.
+
+dlx_t dlx_template;
+
+static void dlx_init(void)
+{
+    dlx_t  * d = &dlx_template;
+    uint32_t col, row, locidx, value, i, node, cols[4];
+
+    // init the root and the column headers, as a circular list
+    for (col = 0; col <= DLX_MAX_COL; col++) {
+        d->L[col] = (col == 0 ? DLX_MAX_COL : col - 1);
+        d->R[col] = (col == DLX_MAX_COL ? 0 : col + 1);
+        d->U[col] = col;
+        d->D[col] = col;
+        d->C[col] = col;
+        d->S[col] = 0;
+    }
+
+    // add the 4 nodes of each row, each node is appended to the bottom of its column
+    node = DLX_MAX_COL + 1;
+    for (row = 0; row < DLX_MAX_ROW; row++) {
+        locidx = row / MAX_VALUE;
+        value  = row % MAX_VALUE;
+        cols[0] = 1 + locidx;
+        cols[1] = 1 + MAX_LOC + units_of[locidx][0] * MAX_VALUE + value;
+        cols[2] = 1 + MAX_LOC + units_of[locidx][1] * MAX_VALUE + value;
+        cols[3] = 1 + MAX_LOC + units_of[locidx][2] * MAX_VALUE + value;
+        for (i = 0; i < 4; i++) {
+            col = cols[i];
+            d->L[node+i]    = node + (i+3) % 4;
+            d->R[node+i]    = node + (i+1) % 4;
+            d->U[node+i]    = d->U[col];
+            d->D[node+i]    = col;
+            d->D[d->U[col]] = node+i;
+            d->U[col]       = node+i;
+            d->C[node+i]    = col;
+            d->row[node+i]  = row;
+            d->S[col]++;
+        }
+        node += 4;
+    }
+    assert(node == DLX_MAX_NODE);
+}
+
+static inline void dlx_cover(dlx_t * d, uint32_t col)
+{
+    uint32_t i, j;
+
+    d->L[d->R[col]] = d->L[col];
+    d->R[d->L[col]] = d->R[col];
+    for (i = d->D[col]; i != col; i = d->D[i]) {
+        for (j = d->R[i]; j != i; j = d->R[j]) {
+            d->U[d->D[j]] = d->U[j];
+            d->D[d->U[j]] = d->D[j];
+            d->S[d->C[j]]--;
+        }
+    }
+}
+
+static inline void dlx_uncover(dlx_t * d, uint32_t col)
+{
+    uint32_t i, j;
+
+    for (i = d->U[col]; i != col; i = d->U[i]) {
+        for (j = d->L[i]; j != i; j = d->L[j]) {
+            d->S[d->C[j]]++;
+            d->U[d->D[j]] = j;
+            d->D[d->U[j]] = j;
+        }
+    }
+    d->L[d->R[col]] = col;
+    d->R[d->L[col]] = col;
+}
+
+static void dlx_board(dlx_t * d, uint32_t depth, board_t * b)
+{
+    uint32_t i;
+
+    // the board the search started from, with the values of
+    // the rows selected by the search set
+    *b = d->b;
+    for (i = 0; i < depth; i++) {
+        board_set(b, d->row[d->O[i]] / MAX_VALUE, d->row[d->O[i]] % MAX_VALUE + 1);
+    }
+}
+
+static void dlx_search(worker_t * w, dlx_t * d, uint32_t depth, uint32_t branch_depth)
+{
+    sudoku_ctx_t * ctx = w->ctx;
+    uint32_t col, c, min_size, r, j, i, rows[MAX_VALUE], max_rows;
+    board_t  b;
+
+    // if interrupted, or checkpointing, then save the branch state in the
+    // frontier, and return
+    if (search_stop(w)) {
+        dlx_board(d, depth, &b);
+        frontier_add(w, &b);
+        return;
+    }
+
+    // if the limit on number of solutions is reached then return
+    if (w->job->max_solutions != MAX_SOLUTIONS_INFINITE && w->job->num_solutions >= w->job->max_solutions) {
+        return;
+    }
+
+    // keep track of the number of search nodes
+    w->num_nodes++;
+
+    // if all columns are covered then the selected rows, along with 
+    // the board the search started from, are a solution
+    if (d->R[0] == 0) {
+        dlx_board(d, depth, &b);
+        record_solution(w, &b.p);
+        return;
+    }
+
+    // choose the column with the fewest nodes; if that column 
+    // has no nodes then there is no solution
+    col = d->R[0];
+    min_size = d->S[col];
+    for (c = d->R[col]; c != 0 && min_size > 1; c = d->R[c]) {
+        if (d->S[c] < min_size) {
+            col = c;
+            min_size = d->S[c];
+        }
+    }
+    if (min_size == 0) {
+        return;
+    }
+
+    // get the rows that cover the column; when near the top of the search
+    // tree all but the first row are pushed on the worker's deque as boards, 
+    // so they can be stolen by idle workers; the depth of the search tree
+    // is the number of branch decisions, columns with just one row don't count
+    if (min_size > 1) {
+        branch_depth++;
+    }
+    max_rows = 0;
+    for (r = d->D[col]; r != col; r = d->D[r]) {
+        if (max_rows > 0 && ctx->max_threads > 1 && w->job->split && d->b.depth + branch_depth <= ctx->split_depth) {
+            dlx_board(d, depth, &b);
+            board_set(&b, d->row[r] / MAX_VALUE, d->row[r] % MAX_VALUE + 1);
+            b.depth += branch_depth;
+            if (deque_push(w, &b)) {
+                continue;
+            }
+        }
+        rows[max_rows++] = r;
+    }
+
+    // try each of the rows that were not pushed
+    dlx_cover(d, col);
+    for (i = 0; i < max_rows; i++) {
+        r = rows[i];
+        d->O[depth] = r;
+        for (j = d->R[r]; j != r; j = d->R[j]) {
+            dlx_cover(d, d->C[j]);
+        }
+        dlx_search(w, d, depth+1, branch_depth);
+        for (j = d->L[r]; j != r; j = d->L[j]) {
+            dlx_uncover(d, d->C[j]);
+        }
+    }
+    dlx_uncover(d, col);
+}
+
+static void dlx_find_solutions(worker_t * w, board_t * b)
+{
+    dlx_t  * d;
+    uint32_t locidx, r, j;
+
+    // allocate the worker's dlx
+    if (w->dlx == NULL) {
+        w->dlx = malloc(sizeof(dlx_t));
+        if (w->dlx == NULL) {
+            printf("ERROR: failed to allocate dlx\n");
+            exit(1);
+        }
+    }
+    d = w->dlx;
+
+    // copy the matrix from the template, and select the row
+    // of each value that is set on the board
+    memcpy(d, &dlx_template, offsetof(dlx_t, O));
+    d->b = *b;
+    for (locidx = 0; locidx < MAX_LOC; locidx++) {
+        if (b->p.value[locidx] == NO_VALUE) {
+            continue;
+        }
+        r = DLX_MAX_COL + 1 + 4 * (locidx * MAX_VALUE + b->p.value[locidx] - 1);
+        dlx_cover(d, d->C[r]);
+        for (j = d->R[r]; j != r; j = d->R[j]) {
+            dlx_cover(d, d->C[j]);
+        }
+    }
+
+    // search for the solutions
+    dlx_search(w, d, 0, 0);
+}
+
+// -----------------  NAKED SINGLES KERNELS  -----------------------
+
+// The naked singles kernels make a pass over the blank locations. The scalar
+// kernel determines the possible values of one location at a time, and sets
+// a value as soon as it is found, so later locations of the pass see it.
+//
+// The avx2 kernel, which is for 9x9 boards, determines the possible values 
+// of 16 locations at a time, in 16 bit lanes, for all 81 locations:
+// - the row, col, and grid bitmasks of each location are looked up with
+//   byte shuffles, from tables of the 9 used bitmasks of each kind of unit
+// - vector compares find the blank locations with 0 and 1 possible values
+// - the location with the least number of possible values is found with a
+//   vector min of (num_pv << 8 | locidx), which selects the same location as
+//   the scalar kernel, the first with the least
+// The singles are then set one at a time; a single's possible values are
+// determined again before it is set, because a value set earlier in the pass
+// may conflict.
+
+static int32_t naked_singles_scalar(board_t * b, uint32_t * best_locidx, uint32_t * best_pv, uint32_t * best_num_pv)
+{
+    uint32_t locidx, pv, num_pv;
+    int32_t  changes = 0;
+
+    *best_num_pv = MAX_VALUE + 1;
+    for (locidx = 0; locidx < MAX_LOC; locidx++) {
+        if (b->p.value[locidx] != NO_VALUE) {
+            continue;
+        }
+
+        possible_values(b,locidx,&pv,&num_pv);   
+
+        if (num_pv == 0) {
+            return -1;
+        } else if (num_pv == 1) {
+            board_set(b, locidx, PV2VAL(pv));
+            changes++;
+        } else if (num_pv < *best_num_pv) {
+            *best_num_pv = num_pv;
+            *best_locidx = locidx;
+            *best_pv     = pv;
+        }
+    }
+    return changes;
+}
+
+#if defined(__x86_64__) && BOX_SIZE == 3
+__attribute__((target("avx2")))
+static int32_t naked_singles_avx2(board_t * b, uint32_t * best_locidx, uint32_t * best_pv, uint32_t * best_num_pv)
+{
+    uint16_t pv_lanes[96] __attribute__((aligned(32)));
+    uint32_t single[3], locidx, pv, num_pv, i, k;
+    int32_t  changes = 0;
+    __m256i  lo_tbl[3], hi_tbl[3], any_zero, best;
+    __m128i  best128;
+
+    __m256i all_pv    = _mm256_set1_epi16(0x3fe);
+    __m256i no_value  = _mm256_set1_epi16(NO_VALUE);
+    __m256i low_byte  = _mm256_set1_epi16(0xff);
+    __m256i low_nib   = _mm256_set1_epi8(0x0f);
+    __m256i nib_count = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+                                         0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+    __m256i lane_idx  = _mm256_setr_epi16(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+    __m256i valid_end = _mm256_set1_epi16(81);
+
+    // make tables of the low and high bytes of the used bitmasks of
+    // the rows, cols, and grids; each table is in both 128 bit halves 
+    // because the byte shuffles are within a half
+    for (i = 0; i < 3; i++) {
+        __m128i u0 = _mm_loadu_si128((__m128i*)&b->used[9*i]);
+        __m128i u1 = _mm_loadu_si128((__m128i*)&b->used[9*i+8]);
+        u1 = _mm_and_si128(u1, _mm_setr_epi16(-1,0,0,0,0,0,0,0));
+        lo_tbl[i] = _mm256_broadcastsi128_si256(
+                        _mm_packus_epi16(_mm_and_si128(u0, _mm_set1_epi16(0xff)),
+                                         _mm_and_si128(u1, _mm_set1_epi16(0xff))));
+        hi_tbl[i] = _mm256_broadcastsi128_si256(
+                        _mm_packus_epi16(_mm_srli_epi16(u0, 8), _mm_srli_epi16(u1, 8)));
+    }
+
+    // determine the possible values of 16 locations at a time, and the 
+    // blank locations with 0 and 1 possible values
+    any_zero = _mm256_setzero_si256();
+    best = _mm256_set1_epi16(-1);
+    memset(single, 0, sizeof(single));
+    for (k = 0; k < 6; k++) {
+        __m256i used, ctl, pv_v, blank, zero, one, cnt, key, idx;
+
+        used = _mm256_loadu_si256((__m256i*)&b->excluded[16*k]);
+        for (i = 0; i < 3; i++) {
+            ctl  = _mm256_load_si256((__m256i*)&kernel_shuffle[i][32*k]);
+            used = _mm256_or_si256(used, _mm256_shuffle_epi8(lo_tbl[i], ctl));
+            used = _mm256_or_si256(used, _mm256_slli_epi16(_mm256_shuffle_epi8(hi_tbl[i], ctl), 8));
+        }
+        pv_v = _mm256_andnot_si256(used, all_pv);
+
+        // blank lanes are the locations, up to 80, with NO_VALUE 
+        idx   = _mm256_add_epi16(lane_idx, _mm256_set1_epi16(16*k));
+        blank = _mm256_cmpeq_epi16(
+                    _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*)&b->p.value[16*k])), no_value);
+        blank = _mm256_and_si256(blank, _mm256_cmpgt_epi16(valid_end, idx));
+        pv_v  = _mm256_and_si256(pv_v, blank);
+        _mm256_store_si256((__m256i*)&pv_lanes[16*k], pv_v);
+
+        // zero: blank with no possible values; one: a single bit is set
+        zero = _mm256_and_si256(blank, _mm256_cmpeq_epi16(pv_v, _mm256_setzero_si256()));
+        any_zero = _mm256_or_si256(any_zero, zero);
+        one = _mm256_cmpeq_epi16(_mm256_and_si256(pv_v, _mm256_sub_epi16(pv_v, _mm256_set1_epi16(1))),
+                                 _mm256_setzero_si256());
+        one = _mm256_andnot_si256(zero, _mm256_and_si256(blank, one));
+
+        // movemask gives 2 bits per 16 bit lane; single[k/2] has the even
+        // bits of vector k when k is even, and the odd bits when k is odd
+        single[k/2] |= (uint32_t)(_mm256_movemask_epi8(one) & 0x55555555) << (k & 1);
+
+        // key = num_pv << 8 | locidx, of the blank locations with 2 or more
+        // possible values
+        cnt = _mm256_add_epi8(_mm256_shuffle_epi8(nib_count, _mm256_and_si256(pv_v, low_nib)),
+                              _mm256_shuffle_epi8(nib_count, _mm256_and_si256(_mm256_srli_epi16(pv_v, 4), low_nib)));
+        cnt = _mm256_add_epi16(_mm256_and_si256(cnt, low_byte), _mm256_srli_epi16(cnt, 8));
+        key = _mm256_or_si256(_mm256_slli_epi16(cnt, 8), idx);
+        key = _mm256_or_si256(key, _mm256_or_si256(_mm256_xor_si256(blank, _mm256_set1_epi16(-1)), one));
+        best = _mm256_min_epu16(best, key);
+    }
+
+    // if a blank location has no possible values then return contradiction
+    if (!_mm256_testz_si256(any_zero, any_zero)) {
+        return -1;
+    }
+
+    // set the singles
+    for (k = 0; k < 3; k++) {
+        while (single[k]) {
+            i = __builtin_ctz(single[k]);
+            single[k] &= single[k] - 1;
+            locidx = 32 * k + (i & 1) * 16 + i / 2;
+            possible_values(b,locidx,&pv,&num_pv);
+            if (num_pv == 0) {
+                return -1;
+            }
+            board_set(b, locidx, pv2val[pv]);
+            changes++;
+        }
+    }
+
+    // the location with the least number of possible values
+    best128 = _mm_minpos_epu16(_mm_min_epu16(_mm256_castsi256_si128(best),
+                                             _mm256_extracti128_si256(best, 1)));
+    *best_num_pv = 10;
+    if ((uint16_t)_mm_extract_epi16(best128, 0) != 0xffff) {
+        *best_locidx = _mm_extract_epi16(best128, 0) & 0xff;
+        *best_num_pv = _mm_extract_epi16(best128, 0) >> 8;
+        *best_pv     = pv_lanes[*best_locidx];
+    }
+    return changes;
+}
+#endif
+
+// -----------------  PROPAGATION STRATEGIES  ----------------------
+
+// The propagation pipeline is the list of strategies that find_solutions
+// runs before it branches. Naked singles are always first, and are done
+// by the naked singles kernel. The other strategies return -1 when they find 
+// the board has no solution, otherwise the number of values they set or
+// eliminated.
+
+static bool pipeline_contains(sudoku_ctx_t * ctx, uint32_t strategy)
+{
+    uint32_t i;
+
+    for (i = 0; i < ctx->max_pipeline; i++) {
+        if (ctx->pipeline[i] == strategy) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool pipeline_select(sudoku_ctx_t * ctx, char * names)
+{
+    char     buff[100], *name, *saveptr;
+    uint32_t i;
+
+    // naked singles are always run first
+    ctx->pipeline[0] = STRATEGY_NAKED_SINGLES;
+    ctx->max_pipeline = 1;
+
+    // add the strategies in the comma seperated names list to the pipeline
+    if (strlen(names) >= sizeof(buff)) {
+        snprintf(ctx->error, sizeof(ctx->error), "strategies are invalid");
+        return false;
+    }
+    strcpy(buff, names);
+    for (name = strtok_r(buff, ",", &saveptr); name; name = strtok_r(NULL, ",", &saveptr)) {
+        for (i = 0; i < MAX_STRATEGY; i++) {
+            if (strcmp(name, strategy_tbl[i].name) == 0) {
+                break;
+            }
+        }
+        if (i == MAX_STRATEGY) {
+            snprintf(ctx->error, sizeof(ctx->error), "strategy '%s' is invalid", name);
+            return false;
+        }
+        if (pipeline_contains(ctx, i)) {
+            continue;
+        }
+        ctx->pipeline[ctx->max_pipeline++] = i;
+    }
+
+    return true;
+}
+
+static int32_t hidden_singles(board_t * b)
+{
+    uint32_t unit, i, locidx, pv, num_pv, once, twice, hidden, value;
+    int32_t  changes = 0;
+
+    // for each unit, find the values that are possible in just one of the  
+    // unit's locations, and set those values
+    for (unit = 0; unit < MAX_UNIT; unit++) {
+        once = twice = 0;
+        for (i = 0; i < MAX_VALUE; i++) {
+            locidx = unit_locs[unit][i];
+            if (b->p.value[locidx] != NO_VALUE) {
+                continue;
+            }
+            possible_values(b, locidx, &pv, &num_pv);
+            twice |= (once & pv);
+            once  |= pv;
+        }
+
+        // if a value is neither used in the unit nor possible in any of the
+        // unit's locations then there is no solution
+        if ((once | b->used[unit]) != ALL_VALUES) {
+            return -1;
+        }
+
+        // set each value that is possible in just one location; the location is
+        // checked again because values set earlier in this loop may have removed
+        // the value from the location, in which case there is no solution
+        hidden = once & ~twice & ~b->used[unit];
+        while (hidden) {
+            value = __builtin_ctz(hidden);
+            hidden &= ~(1 << value);
+            for (i = 0; i < MAX_VALUE; i++) {
+                locidx = unit_locs[unit][i];
+                if (b->p.value[locidx] != NO_VALUE) {
+                    continue;
+                }
+                possible_values(b, locidx, &pv, &num_pv);
+                if (pv & (1 << value)) {
+                    break;
+                }
+            }
+            if (i == MAX_VALUE) {
+                return -1;
+            }
+            board_set(b, locidx, value);
+            changes++;
+        }
+    }
+
+    return changes;
+}
+
+static int32_t eliminate_subset(board_t * b, uint32_t unit, uint32_t subset_locs, uint32_t subset_pv)
+{
+    uint32_t i, locidx, pv, num_pv, elim;
+    int32_t  changes = 0;
+
+    // eliminate the subset's values from the unit's other blank locations;
+    // subset_locs is a bitmask of the indexes, within the unit, of the subset's locations
+    for (i = 0; i < MAX_VALUE; i++) {
+        locidx = unit_locs[unit][i];
+        if (b->p.value[locidx] != NO_VALUE || (subset_locs & (1 << i))) {
+            continue;
+        }
+        possible_values(b, locidx, &pv, &num_pv);
+        elim = pv & subset_pv;
+        if (elim == 0) {
+            continue;
+        }
+        if (elim == pv) {
+            return -1;
+        }
+        board_exclude(b, locidx, elim);
+        changes += __builtin_popcount(elim);
+    }
+
+    return changes;
+}
+
+static int32_t naked_subsets(board_t * b, uint32_t size)
+{
+    uint32_t unit, i, j, k, locidx, pv, num_pv;
+    uint32_t cand_idx[MAX_VALUE], cand_pv[MAX_VALUE], max_cand;
+    int32_t  n, changes = 0;
+
+    // for each unit, find a subset of 'size' blank locations whose possible 
+    // values, combined, are just 'size' values; those values must be in the
+    // subset's locations, and so are eliminated from the unit's other locations
+    for (unit = 0; unit < MAX_UNIT; unit++) {
+        // get the blank locations that have 2 to size possible values,
+        // these are the candidates for a subset
+        max_cand = 0;
+        for (i = 0; i < MAX_VALUE; i++) {
+            locidx = unit_locs[unit][i];
+            if (b->p.value[locidx] != NO_VALUE) {
+                continue;
+            }
+            possible_values(b, locidx, &pv, &num_pv);
+            if (num_pv >= 2 && num_pv <= size) {
+                cand_idx[max_cand] = i;
+                cand_pv[max_cand] = pv;
+                max_cand++;
+            }
+        }
+        if (max_cand < size) {
+            continue;
+        }
+
+        // examine each subset of the candidates
+        for (i = 0; i < max_cand; i++) {
+            for (j = i+1; j < max_cand; j++) {
+                if (size == 2) {
+                    if (cand_pv[i] != cand_pv[j]) {
+                        continue;
+                    }
+                    n = eliminate_subset(b, unit, 
+                                         (1 << cand_idx[i]) | (1 << cand_idx[j]),
+                                         cand_pv[i]);
+                    if (n < 0) {
+                        return -1;
+                    }
+                    changes += n;
+                    continue;
+                }
+                for (k = j+1; k < max_cand; k++) {
+                    if (__builtin_popcount(cand_pv[i] | cand_pv[j] | cand_pv[k]) != 3) {
+                        continue;
+                    }
+                    n = eliminate_subset(b, unit, 
+                                         (1 << cand_idx[i]) | (1 << cand_idx[j]) | (1 << cand_idx[k]),
+                                         cand_pv[i] | cand_pv[j] | cand_pv[k]);
+                    if (n < 0) {
+                        return -1;
+                    }
+                    changes += n;
+                }
+            }
+        }
+    }
+
+    return changes;
+}
+
+static int32_t naked_pairs(board_t * b)
+{
+    return naked_subsets(b, 2);
+}
+
+static int32_t naked_triples(board_t * b)
+{
+    return naked_subsets(b, 3);
+}
+
+// -----------------  WORKER THREAD POOL  --------------------------
+
+// A fixed pool of max_threads workers is created with the context, and is 
+// used for each run of the solver. A run is either the search for the solutions
+// of a puzzle, or the solving of a window of batch puzzles.
+//
+// Each worker has a deque of pending branch states. The owner pushes and 
+// pops at the bottom, so it works depth first on the most recent branch states.
+// An idle worker steals from the top of another worker's deque, this is the
+// shallowest branch state, which is usually the largest subtree. In batch mode
+// the workers also claim chunks of the batch input, in order; the puzzles of
+// the chunk are parsed and solved by the claiming worker, without pushing 
+// branch states on its deque.
+//
+// Starting a run, and its completion, are signaled with condition 
+// variables, protected by the pool mutex:
+// - run_cond: the workers wait on this for a run to be started,
+//   or for the pool to be destroyed
+// - done_cond: pool_run waits on this for all workers to be waiting,
+//   and for the run to be complete
+//
+// When ctx->affinity is set each worker is pinned to a cpu, see affinity_select,
+// and its memory is on its numa node: each worker is in its own pages, which 
+// are first written by the worker thread once it is pinned, as are its task 
+// pool slabs, and its dlx and iter; and an idle worker steals from the workers
+// on its own node before those on other nodes.
+//
+// A run is complete when all workers are idle. Because a worker only 
+// becomes idle after it finds its own deque empty and no frontier branch
+// states or batch chunks left to claim, and a thief claims a task (decrements num_idle) while 
+// holding the victim's deque_mutex, when num_idle reaches max_threads all
+// of the deques are empty.
+
+static void pool_create(sudoku_ctx_t * ctx)
+{
+    pool_t * pool = ctx->pool;
+    worker_start_t * start;
+    pthread_t thread_id;
+    uint32_t i;
+
+    // allocate the workers, each worker is initialized by its thread, so 
+    // that its pages are first written on the worker's numa node
+    pool->workers = aligned_alloc(PAGE_SIZE, ctx->max_threads * sizeof(worker_t));
+    start = malloc(ctx->max_threads * sizeof(worker_start_t));
+    if (pool->workers == NULL || start == NULL) {
+        printf("ERROR: failed to allocate %d workers\n", ctx->max_threads);
+        exit(1);
+    }
+    pool->num_nodes = 1;
+    if (ctx->affinity) {
+        affinity_select(ctx);
+    }
+
+    // create the worker threads, and wait for them to be waiting for a 
+    // run to be started, when their workers are initialized
+    for (i = 0; i < ctx->max_threads; i++) {
+        start[i].ctx = ctx;
+        start[i].id  = i;
+        ctx->stats.num_thread_creates++;
+        __sync_fetch_and_add(&pool->num_threads, 1);
+        pthread_create(&thread_id, NULL, worker_thread, &start[i]);
+    }
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->num_waiting != ctx->max_threads) {
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    free(start);
+}
+
+static void pool_run(sudoku_ctx_t * ctx, uint32_t checkpoint_interval)
+{
+    // start the run, and wait for it to complete
+    pool_start(ctx);
+    pool_wait(ctx, checkpoint_interval);
+}
+
+static void pool_start(sudoku_ctx_t * ctx)
+{
+    pool_t * pool = ctx->pool;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    // wait for all workers to be waiting for the run to start
+    while (pool->num_waiting != ctx->max_threads) {
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    }
+
+    // keep track of the start time statistic, and start the run
+    pool->num_idle = 0;
+    pool->done = false;
+    pool->start_us = microsec_timer();
+    pool->generation++;
+    pthread_cond_broadcast(&pool->run_cond);
+
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+static void pool_wait(sudoku_ctx_t * ctx, uint32_t checkpoint_interval)
+{
+    pool_t * pool = ctx->pool;
+    struct timespec ts;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    // wait for the run to complete; when checkpoint_interval is set and 
+    // the run is not complete after that many seconds then request a 
+    // checkpoint, which stops the run
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += checkpoint_interval;
+    while (!pool->done) {
+        if (checkpoint_interval && !pool->checkpoint) {
+            if (pthread_cond_timedwait(&pool->done_cond, &pool->mutex, &ts) == ETIMEDOUT) {
+                pool->checkpoint = true;
+            }
+        } else {
+            pthread_cond_wait(&pool->done_cond, &pool->mutex);
+        }
+    }
+
+    ctx->stats.duration_us += pool->end_us - pool->start_us;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+static void pool_destroy(sudoku_ctx_t * ctx)
+{
+    pool_t * pool = ctx->pool;
+    uint32_t i;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->run_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (i = 0; i < ctx->max_threads; i++) {
+        pthread_join(pool->workers[i].thread_id, NULL);
+    }
+}
+
+static void run_task(worker_t * w, board_t * b)
+{
+    sudoku_ctx_t * ctx = w->ctx;
+    uint64_t start_nodes = w->num_nodes;
+    uint64_t size;
+    uint32_t n;
+
+    // find the solutions of the branch state, using the selected engine; 
+    // with the restart heuristic, a search for the first solution that is 
+    // not split is restarted, see restart_find_solutions
+    if (ctx->engine == ENGINE_DLX) {
+        dlx_find_solutions(w, b);
+    } else if (ctx->heuristic == HEURISTIC_RESTART && w->job->max_solutions == 1 && !w->job->count && 
+               !w->job->checkpoint && !(ctx->max_threads > 1 && w->job->split)) {
+        restart_find_solutions(w, b);
+    } else if (ctx->engine == ENGINE_ITER) {
+        iter_find_solutions(w, b);
+    } else {
+        find_solutions(w, *b);
+    }
+
+    // keep track of the task size statistics, the size of a task is the 
+    // number of nodes it examined, not including the tasks it pushed
+    size = w->num_nodes - start_nodes;
+    if (ctx->engine != ENGINE_DLX) {
+        w->heuristic_nodes[ctx->heuristic] += size;
+    }
+    n = (size == 0 ? 0 : 63 - __builtin_clzll(size));
+    w->task_size_hist[n < MAX_TASK_SIZE_HIST ? n : MAX_TASK_SIZE_HIST-1]++;
+    if (size > w->max_task_size) {
+        w->max_task_size = size;
+    }
+
+    // in count only mode, add the solutions counted by this task to the job
+    if (w->job->count) {
+        count_flush(w);
+    }
+}
+
+static bool batch_claim(worker_t * w)
+{
+    pool_t * pool = w->pool;
+    uint32_t idx;
+
+    // claim the next batch chunk, and solve or generate its puzzles
+    if (pool->batch_next >= pool->max_batch_chunks) {
+        return false;
+    }
+    idx = __sync_fetch_and_add(&pool->batch_next, 1);
+    if (idx >= pool->max_batch_chunks) {
+        return false;
+    }
+    if (pool->generate) {
+        generate_chunk(w, &pool->batch_chunks[idx]);
+    } else {
+        batch_chunk(w, &pool->batch_chunks[idx]);
+    }
+    return true;
+}
+
+static bool frontier_claim(worker_t * w)
+{
+    pool_t * pool = w->pool;
+    board_t  b;
+    uint64_t idx;
+
+    // claim the next branch state of the frontier the run was started
+    // from, and find its solutions
+    if (pool->frontier_next >= pool->max_frontier) {
+        return false;
+    }
+    idx = __sync_fetch_and_add(&pool->frontier_next, 1);
+    if (idx >= pool->max_frontier) {
+        return false;
+    }
+    board_init(&b, &pool->frontier[idx]);
+    w->num_tasks++;
+    w->job = pool->deque_job;
+    run_task(w, &b);
+    return true;
+}
+
+static void worker_run(worker_t * w)
+{
+    pool_t * pool = w->pool;
+    task_t * t;
+
+    // the worker is busy until it is idle, the busy time is kept for the metrics
+    w->busy_since = microsec_timer();
+    while (true) {
+        // if there is a branch state on this worker's deque, or a frontier
+        // branch state, batch chunk, or async request to claim, then 
+        //   find the solutions for it, and continue
+        // endif
+        if ((t = deque_pop(w)) != NULL) {
+            w->num_tasks++;
+            w->job = pool->deque_job;
+            run_task(w, &t->b);
+            task_free(w, t);
+            continue;
+        }
+        if (frontier_claim(w) || batch_claim(w) || async_claim(w)) {
+            continue;
+        }
+
+        // this worker is idle; if all workers are idle then
+        //   keep track of the completion time statistic, and
+        //   set the done flag
+        // endif
+        w->busy_us += microsec_timer() - w->busy_since;
+        w->busy_since = 0;
+        if (__sync_add_and_fetch(&pool->num_idle, 1) == w->ctx->max_threads) {
+            pool->end_us = microsec_timer();
+            pthread_mutex_lock(&pool->mutex);
+            pool->done = true;
+            pthread_cond_broadcast(&pool->done_cond);
+            pthread_mutex_unlock(&pool->mutex);
+            return;
+        }
+
+        // steal a branch state from another worker, or
+        // return when the run is done
+        while (!pool->done && (t = deque_steal(w)) == NULL) {
+            sched_yield();
+        }
+        if (pool->done) {
+            return;
+        }
+        w->busy_since = microsec_timer();
+        w->num_tasks++;
+        w->num_steals++;
+        w->job = pool->deque_job;
+        run_task(w, &t->b);
+        task_free(w, t);
+    }
+}
+
+static void * worker_thread(void * cx) 
+{
+    worker_start_t * start = cx;
+    pool_t   * pool = start->ctx->pool;
+    worker_t * w = &pool->workers[start->id];
+    uint32_t   generation = 0;
+    cpu_set_t  cpus;
+
+    // pin this thread to its cpu, and then init its worker
+    if (pool->worker_cpu) {
+        CPU_ZERO(&cpus);
+        CPU_SET(pool->worker_cpu[start->id], &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    memset(w, 0, sizeof(worker_t));
+    w->thread_id = pthread_self();
+    w->id        = start->id;
+    w->ctx       = start->ctx;
+    w->pool      = pool;
+    w->cpu       = (pool->worker_cpu ? pool->worker_cpu[w->id] : -1);
+    w->node      = (pool->worker_node ? pool->worker_node[w->id] : 0);
+    pthread_mutex_init(&w->deque_mutex, NULL);
+
+    while (true) {
+        // wait for the next run to be started, or the pool to be destroyed
+        pthread_mutex_lock(&pool->mutex);
+        if (++pool->num_waiting == w->ctx->max_threads) {
+            pthread_cond_broadcast(&pool->done_cond);
+        }
+        while (pool->generation == generation && !pool->shutdown) {
+            pthread_cond_wait(&pool->run_cond, &pool->mutex);
+        }
+        if (pool->shutdown) {
+            pthread_mutex_unlock(&pool->mutex);
+            break;
+        }
+        generation = pool->generation;
+        pool->num_waiting--;
+        pthread_mutex_unlock(&pool->mutex);
+
+        // work on the run until it is complete
+        worker_run(w);
+    }
+
+    // keep track of number of threads that are active
+    __sync_sub_and_fetch(&pool->num_threads, 1);
+
+    // free the worker's dlx, iter, and frontier, if allocated
+    free(w->dlx);
+    free(w->iter);
+    free(w->frontier);
+
+    // return
+    return NULL;
+}
+
+static bool deque_push(worker_t * w, board_t * b)
+{
+    task_t * t;
+
+    // the deque holds tasks; the branch state is copied to a task from
+    // the worker's task pool before taking the mutex
+    if (w->deque_bottom - w->deque_top >= DEQUE_SIZE) {
+        return false;
+    }
+    t = task_alloc(w);
+    t->b = *b;
+
+    pthread_mutex_lock(&w->deque_mutex);
+    if (w->deque_bottom - w->deque_top < DEQUE_SIZE) {
+        w->deque[w->deque_bottom % DEQUE_SIZE] = t;
+        w->deque_bottom++;
+        t = NULL;
+    }
+    pthread_mutex_unlock(&w->deque_mutex);
+
+    if (t) {
+        task_free(w, t);
+        return false;
+    }
+    return true;
+}
+
+static task_t * deque_pop(worker_t * w)
+{
+    task_t * t = NULL;
+
+    pthread_mutex_lock(&w->deque_mutex);
+    if (w->deque_bottom != w->deque_top) {
+        w->deque_bottom--;
+        t = w->deque[w->deque_bottom % DEQUE_SIZE];
+    }
+    pthread_mutex_unlock(&w->deque_mutex);
+
+    return t;
+}
+
+static task_t * deque_steal(worker_t * w)
+{
+    sudoku_ctx_t * ctx = w->ctx;
+    pool_t * pool = w->pool;
+    uint32_t i, pass;
+    worker_t * victim;
+
+    // scan the other workers, starting with the next one, for a non empty deque;
+    // the unlocked check avoids taking the mutex of workers that have nothing to steal;
+    // when the workers are on more than one numa node, the first pass scans 
+    // the workers on this worker's node, and the second pass the others
+    for (pass = 0; pass < (pool->num_nodes > 1 ? 2 : 1); pass++) {
+    for (i = 1; i < ctx->max_threads; i++) {
+        victim = &pool->workers[(w->id + i) % ctx->max_threads];
+        if (victim->deque_bottom == victim->deque_top ||
+            (pool->num_nodes > 1 && (victim->node == w->node) != (pass == 0)))
+        {
+            continue;
+        }
+
+        // take the branch state from the top of the victim's deque, and no longer
+        // be idle, while holding the victim's mutex
+        pthread_mutex_lock(&victim->deque_mutex);
+        if (victim->deque_bottom != victim->deque_top) {
+            task_t * t = victim->deque[victim->deque_top % DEQUE_SIZE];
+            victim->deque_top++;
+            __sync_sub_and_fetch(&pool->num_idle, 1);
+            pthread_mutex_unlock(&victim->deque_mutex);
+            w->num_remote_steals += (victim->node != w->node);
+            return t;
+        }
+        pthread_mutex_unlock(&victim->deque_mutex);
+    }
+    }
+
+    return NULL;
+}
+
+static bool affinity_read_cpulist(uint32_t node, cpu_set_t * cpus)
+{
+    char   path[100], s[1000], * p;
+    FILE * fp;
+    int    first, last, cpu;
+
+    // read the cpus of a numa node, the cpulist is ranges such as "0-7,16-23"
+    CPU_ZERO(cpus);
+    sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        return false;
+    }
+    if (fgets(s, sizeof(s), fp) == NULL) {
+        s[0] = '\0';
+    }
+    fclose(fp);
+    for (p = s; sscanf(p, "%d", &first) == 1; p++) {
+        last = first;
+        p += strspn(p, "0123456789");
+        if (*p == '-' && sscanf(p+1, "%d", &last) == 1) {
+            p += 1 + strspn(p+1, "0123456789");
+        }
+        for (cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, cpus);
+        }
+        if (*p != ',') {
+            break;
+        }
+    }
+    return true;
+}
+
+static void affinity_select(sudoku_ctx_t * ctx)
+{
+    pool_t  * pool = ctx->pool;
+    cpu_set_t allowed, node_cpus, found;
+    int32_t   cpu_tbl[CPU_SETSIZE];
+    uint32_t  node_tbl[CPU_SETSIZE], max_cpu = 0, node, i;
+    int32_t   cpu;
+    bool      used[AFFINITY_MAX_NODES] = { false };
+
+    // select the cpu of each worker: the cpus this process may run on are
+    // ordered by numa node, and by cpu number within a node, and worker i 
+    // is pinned to the i'th, wrapping around when there are more workers 
+    // than cpus; so the workers are on the fewest nodes, and the workers of
+    // a node have adjacent ids; a cpu not in a node's cpulist, as when the 
+    // system has no numa nodes in sysfs, is on node 0
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        return;
+    }
+    CPU_ZERO(&found);
+    for (node = 0; node < AFFINITY_MAX_NODES; node++) {
+        if (!affinity_read_cpulist(node, &node_cpus)) {
+            continue;
+        }
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &node_cpus) && CPU_ISSET(cpu, &allowed) && !CPU_ISSET(cpu, &found)) {
+                CPU_SET(cpu, &found);
+                cpu_tbl[max_cpu] = cpu;
+                node_tbl[max_cpu++] = node;
+            }
+        }
+    }
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && !CPU_ISSET(cpu, &found)) {
+            cpu_tbl[max_cpu] = cpu;
+            node_tbl[max_cpu++] = 0;
+        }
+    }
+    if (max_cpu == 0) {
+        return;
+    }
+
+    // set the cpu and node of each worker, and the number of nodes used
+    pool->worker_cpu  = malloc(ctx->max_threads * sizeof(int32_t));
+    pool->worker_node = malloc(ctx->max_threads * sizeof(uint32_t));
+    if (pool->worker_cpu == NULL || pool->worker_node == NULL) {
+        printf("ERROR: failed to allocate worker cpus\n");
+        exit(1);
+    }
+    pool->num_nodes = 0;
+    for (i = 0; i < ctx->max_threads; i++) {
+        pool->worker_cpu[i]  = cpu_tbl[i % max_cpu];
+        pool->worker_node[i] = node_tbl[i % max_cpu];
+        if (!used[pool->worker_node[i]]) {
+            used[pool->worker_node[i]] = true;
+            pool->num_nodes++;
+        }
+    }
+}
+
+// -----------------  TASK POOL  -----------------------------------
+
+// A task holds a branch state while it is on a deque. Each worker has a 
+// pool of tasks, allocated in slabs of SLAB_TASKS:
+// - the worker allocates from its free list, which only it uses
+// - a task is freed by the worker that ran it; a task of another worker's
+//   pool is returned to that worker's task_returned list, with a lock free 
+//   push, and the owner takes the whole list when its free list is empty
+// - a slab is allocated only when both lists are empty; so once the pools
+//   have grown to the number of tasks in use the system allocator is not
+//   called; the slabs are freed when the context is destroyed
+
+static task_t * task_alloc(worker_t * w)
+{
+    task_t * t;
+    slab_t * slab;
+    uint32_t i;
+
+    // if the free list is empty then take the tasks returned by other
+    // workers, and if there are none then allocate a slab
+    if (w->task_free == NULL) {
+        w->task_free = __sync_lock_test_and_set(&w->task_returned, NULL);
+    }
+    if (w->task_free == NULL) {
+        slab = malloc(sizeof(slab_t));
+        if (slab == NULL) {
+            printf("ERROR: failed to allocate task slab\n");
+            exit(1);
+        }
+        slab->next = w->task_slabs;
+        w->task_slabs = slab;
+        for (i = 0; i < SLAB_TASKS; i++) {
+            slab->task[i].owner = w;
+            slab->task[i].next  = (i < SLAB_TASKS-1 ? &slab->task[i+1] : NULL);
+        }
+        w->task_free = &slab->task[0];
+    }
+
+    // return a task from the free list
+    t = w->task_free;
+    w->task_free = t->next;
+    return t;
+}
+
+static void task_free(worker_t * w, task_t * t)
+{
+    worker_t * owner = t->owner;
+    task_t   * head;
+
+    // put the task back in its owner's pool
+    if (owner == w) {
+        t->next = w->task_free;
+        w->task_free = t;
+        return;
+    }
+    do {
+        head = owner->task_returned;
+        t->next = head;
+    } while (!__sync_bool_compare_and_swap(&owner->task_returned, head, t));
+}
+
+static void task_pool_destroy(worker_t * w)
+{
+    slab_t * slab;
+
+    // free the slabs of the worker's tasks
+    while ((slab = w->task_slabs) != NULL) {
+        w->task_slabs = slab->next;
+        free(slab);
+    }
+    w->task_free = w->task_returned = NULL;
+}
+
+// -----------------  OUTPUT SINK  ---------------------------------
+
+// The solutions output by sudoku_solve_one are written by the workers 
+// to their own sink ring, and the sink writer thread drains the rings to 
+// the output_fd with writev. A ring has a single producer, its worker, and a single
+// consumer, the writer, so it needs no lock:
+// - the worker adds a record at head, and then advances head
+// - the writer writes the records between tail and head, and then advances 
+//   tail, making the space available to the worker again
+//
+// The rings and the writer thread are created by the first solve that 
+// writes to the output_fd, and are kept for the life of the context. When
+// the writer has no records to write it waits on sink_cond; a worker that
+// adds a record signals it when sink_sleeping is set. At the end of a solve
+// sink_flush waits on sink_flush_cond for the records to be written; the 
+// writer signals it, when sink_flushing is set, after advancing the tails.
+// Each of these has a full barrier between its store and the load of the
+// other's, so the signal is not missed.
+//
+// The output_order selects the order the solutions are written in:
+// - any: the records are written as soon as they are found, the output of 
+//   a solution is not interleaved with other solutions
+// - seq: the records are written in solution number order; a worker's
+//   records are in increasing solution number order, so the writer only
+//   needs to look at the first unwritten record of each ring for the next 
+//   solution number
+
+#define SINK_REC_SIZE(len) (sizeof(sink_rec_t) + (((len) + 15) & ~15))
+
+static void * sink_thread(void * cx);
+
+static void sink_create(sudoku_ctx_t * ctx)
+{
+    pool_t * pool = ctx->pool;
+    uint32_t i;
+
+    // allocate the worker rings, and create the writer thread
+    for (i = 0; i < ctx->max_threads; i++) {
+        pool->workers[i].sink = aligned_alloc(64, sizeof(sink_ring_t));
+        if (pool->workers[i].sink == NULL) {
+            printf("ERROR: failed to allocate sink ring\n");
+            exit(1);
+        }
+        pool->workers[i].sink->head = 0;
+        pool->workers[i].sink->tail = 0;
+    }
+    pool->sink_shutdown = false;
+    pthread_create(&pool->sink_thread_id, NULL, sink_thread, ctx);
+}
+
+static void sink_write(worker_t * w, uint64_t ts, void * data, uint32_t len)
+{
+    sink_ring_t * r = w->sink;
+    uint64_t      head = r->head;
+    uint64_t      offset = head & (SINK_RING_SIZE-1);
+    sink_rec_t  * rec;
+
+    // if the record would not be contiguous then add a wrap record,
+    // which uses the rest of the ring
+    if (offset + SINK_REC_SIZE(len) > SINK_RING_SIZE) {
+        while (head + SINK_RING_SIZE - offset + SINK_REC_SIZE(len) - r->tail > SINK_RING_SIZE) {
+            usleep(100);
+            __sync_synchronize();
+        }
+        rec = (sink_rec_t*)&r->buff[offset];
+        rec->ts = ts;
+        rec->len = 0;
+        rec->wrap = true;
+        head += SINK_RING_SIZE - offset;
+        offset = 0;
+    }
+
+    // wait for space in the ring, the writer is behind
+    while (head + SINK_REC_SIZE(len) - r->tail > SINK_RING_SIZE) {
+        usleep(100);
+        __sync_synchronize();
+    }
+
+    // add the record, and advance head; the barrier ensures the 
+    // writer sees the record before the new head
+    rec = (sink_rec_t*)&r->buff[offset];
+    rec->ts = ts;
+    rec->len = len;
+    rec->wrap = false;
+    memcpy(rec+1, data, len);
+    __sync_synchronize();
+    r->head = head + SINK_REC_SIZE(len);
+
+    // wake the writer, when it is waiting for records
+    __sync_synchronize();
+    if (w->pool->sink_sleeping) {
+        pthread_mutex_lock(&w->pool->sink_mutex);
+        pthread_cond_signal(&w->pool->sink_cond);
+        pthread_mutex_unlock(&w->pool->sink_mutex);
+    }
+}
+
+static bool sink_empty(sudoku_ctx_t * ctx)
+{
+    pool_t * pool = ctx->pool;
+    uint32_t i;
+
+    // return true when the writer has written all of the records
+    for (i = 0; i < ctx->max_threads; i++) {
+        if (*(volatile uint64_t *)&pool->workers[i].sink->tail != 
+            *(volatile uint64_t *)&pool->workers[i].sink->head) 
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void sink_flush(sudoku_ctx_t * ctx)
+{
+    pool_t * pool = ctx->pool;
+
+    // wait for the writer to write all of the records
+    pthread_mutex_lock(&pool->sink_mutex);
+    pool->sink_flushing = true;
+    __sync_synchronize();
+    while (!sink_empty(ctx)) {
+        pthread_cond_wait(&pool->sink_flush_cond, &pool->sink_mutex);
+    }
+    pool->sink_flushing = false;
+    pthread_mutex_unlock(&pool->sink_mutex);
+}
+
+static void sink_destroy(sudoku_ctx_t * ctx)
+{
+    pool_t * pool = ctx->pool;
+    uint32_t i;
+
+    // write the remaining records, and terminate the writer thread
+    sink_flush(ctx);
+    pthread_mutex_lock(&pool->sink_mutex);
+    pool->sink_shutdown = true;
+    pthread_cond_signal(&pool->sink_cond);
+    pthread_mutex_unlock(&pool->sink_mutex);
+    pthread_join(pool->sink_thread_id, NULL);
+    for (i = 0; i < ctx->max_threads; i++) {
+        free(pool->workers[i].sink);
+        pool->workers[i].sink = NULL;
+    }
+}
+
+static void sink_wait(sudoku_ctx_t * ctx, uint64_t * head)
+{
+    pool_t * pool = ctx->pool;
+    uint32_t i;
+
+    // wait for a record to be added to a ring, after head, or for shutdown
+    pthread_mutex_lock(&pool->sink_mutex);
+    pool->sink_sleeping = true;
+    __sync_synchronize();
+    while (!pool->sink_shutdown) {
+        for (i = 0; i < ctx->max_threads; i++) {
+            if (*(volatile uint64_t *)&pool->workers[i].sink->head != head[i]) {
+                break;
+            }
+        }
+        if (i < ctx->max_threads) {
+            break;
+        }
+        pthread_cond_wait(&pool->sink_cond, &pool->sink_mutex);
+    }
+    pool->sink_sleeping = false;
+    pthread_mutex_unlock(&pool->sink_mutex);
+}
+
+static void sink_writev(int fd, struct iovec * iov, uint32_t cnt)
+{
+    ssize_t len;
+
+    // write all of the iov, continuing after partial writes
+    while (cnt > 0) {
+        len = writev(fd, iov, cnt > IOV_MAX ? IOV_MAX : cnt);
+        if (len < 0) {
+            perror("writev");
+            exit(1);
+        }
+        while (cnt > 0 && len >= iov->iov_len) {
+            len -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            iov->iov_base += len;
+            iov->iov_len -= len;
+        }
+    }
+}
+
+static void * sink_thread(void * cx)
+{
+    sudoku_ctx_t * ctx = cx;
+    pool_t     * pool = ctx->pool;
+    struct iovec iov[SINK_MAX_IOV];
+    uint64_t     pos[ctx->max_threads], head[ctx->max_threads];
+    uint32_t     cnt, i;
+    sink_rec_t * rec;
+    bool         found;
+
+    while (true) {
+        // get the records that have been added to each ring; and if there 
+        // are none then wait for them, or return when sink_destroy has been
+        // called
+        bool shutdown = pool->sink_shutdown;
+        __sync_synchronize();
+        cnt = 0;
+        for (i = 0; i < ctx->max_threads; i++) {
+            pos[i] = pool->workers[i].sink->tail;
+            head[i] = pool->workers[i].sink->head;
+            cnt += (pos[i] != head[i]);
+        }
+        if (cnt == 0) {
+            if (shutdown) {
+                break;
+            }
+            sink_wait(ctx, head);
+            continue;
+        }
+        __sync_synchronize();
+
+        // gather the records to be written into the iov
+        cnt = 0;
+        if (ctx->output_order == ORDER_ANY) {
+            for (i = 0; i < ctx->max_threads; i++) {
+                while (pos[i] != head[i] && cnt < SINK_MAX_IOV) {
+                    rec = (sink_rec_t*)&pool->workers[i].sink->buff[pos[i] & (SINK_RING_SIZE-1)];
+                    if (rec->wrap) {
+                        pos[i] += SINK_RING_SIZE - (pos[i] & (SINK_RING_SIZE-1));
+                        continue;
+                    }
+                    iov[cnt].iov_base = rec + 1;
+                    iov[cnt].iov_len = rec->len;
+                    cnt++;
+                    pos[i] += SINK_REC_SIZE(rec->len);
+                }
+            }
+        } else {
+            // seq order: repeatedly find the ring whose first record is 
+            // next_ts; the printed solution numbers are 1 and then the 
+            // multiples of print_interval
+            do {
+                found = false;
+                for (i = 0; i < ctx->max_threads && cnt < SINK_MAX_IOV; i++) {
+                    if (pos[i] == head[i]) {
+                        continue;
+                    }
+                    rec = (sink_rec_t*)&pool->workers[i].sink->buff[pos[i] & (SINK_RING_SIZE-1)];
+                    if (rec->wrap) {
+                        pos[i] += SINK_RING_SIZE - (pos[i] & (SINK_RING_SIZE-1));
+                        found = true;
+                        continue;
+                    }
+                    if (rec->ts != pool->sink_next_ts) {
+                        continue;
+                    }
+                    iov[cnt].iov_base = rec + 1;
+                    iov[cnt].iov_len = rec->len;
+                    cnt++;
+                    pos[i] += SINK_REC_SIZE(rec->len);
+                    pool->sink_next_ts = (pool->sink_next_ts / ctx->print_interval + 1) * ctx->print_interval;
+                    found = true;
+                }
+            } while (found && cnt < SINK_MAX_IOV);
+        }
+
+        // write the records, and advance the tails 
+        sink_writev(ctx->output_fd, iov, cnt);
+        __sync_synchronize();
+        for (i = 0; i < ctx->max_threads; i++) {
+            pool->workers[i].sink->tail = pos[i];
+        }
+
+        // wake sink_flush, when it is waiting for the records to be written
+        __sync_synchronize();
+        if (pool->sink_flushing) {
+            pthread_mutex_lock(&pool->sink_mutex);
+            pthread_cond_broadcast(&pool->sink_flush_cond);
+            pthread_mutex_unlock(&pool->sink_mutex);
+        }
+
+        // if the seq order writer is waiting for the next solution to be 
+        // found then wait for it to be added
+        if (cnt == 0) {
+            if (shutdown) {
+                break;
+            }
+            sink_wait(ctx, head);
+        }
+    }
+
+    return NULL;
+}
+
+// -----------------  METRICS  -------------------------------------
+
+// When ctx->metrics_fd is set, a metrics thread writes a JSON line of the
+// context's progress every metrics_interval_ms, for the life of the context.
+// The metrics are read from the per worker counters, without locking, so
+// there is no instrumentation on the workers' hot path; a line has:
+// - t_ms: time since the context was created, and running: a run is in progress
+// - solutions, nodes, passes (of the naked singles kernel), backtracks (branch
+//   states found to have no solution), tasks, steals, cache_hits, 
+//   cache_misses (of the batch result cache): totals of the workers
+// - nodes_per_sec: over the interval
+// - workers: each worker's nodes, steals, deque depth, and util (the fraction
+//   of the interval it was running a task)
+
+static void metrics_worker_busy(worker_t * w, uint64_t now, uint64_t * busy_us)
+{
+    uint64_t since = w->busy_since;
+
+    // the worker's busy time, including the task it is running
+    *busy_us = w->busy_us + (since && now > since ? now - since : 0);
+}
+
+static void * metrics_thread(void * cx)
+{
+    sudoku_ctx_t   * ctx = cx;
+    pool_t         * pool = ctx->pool;
+    uint64_t         now, busy, prior_us, prior_nodes, nodes, solutions, passes, backtracks;
+    uint64_t         tasks, steals, depth, cache_hits, cache_misses;
+    uint64_t       * prior_busy;
+    struct timespec  ts;
+    sigset_t         sigs;
+    worker_t       * w;
+    char           * buff;
+    uint32_t         i, j, len, max;
+
+    // block SIGPIPE in this thread, so a write to a closed pipe fails with 
+    // EPIPE, rather than terminating the process
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+    max = 300 + ctx->max_threads * 120;
+    buff = malloc(max);
+    prior_busy = calloc(ctx->max_threads, sizeof(uint64_t));
+    if (buff == NULL || prior_busy == NULL) {
+        printf("ERROR: failed to allocate metrics buffer\n");
+        exit(1);
+    }
+    prior_us = pool->create_us;
+    prior_nodes = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (true) {
+        // wait for the interval, or the pool to be destroyed
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec  += ctx->metrics_interval_ms / 1000;
+        ts.tv_nsec += (ctx->metrics_interval_ms % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        while (!pool->metrics_shutdown &&
+               pthread_cond_timedwait(&pool->metrics_cond, &pool->mutex, &ts) == 0) ;
+        if (pool->metrics_shutdown) {
+            break;
+        }
+        pthread_mutex_unlock(&pool->mutex);
+
+        // sum the worker counters
+        now = microsec_timer();
+        nodes = solutions = passes = backtracks = tasks = steals = cache_hits = cache_misses = 0;
+        for (i = 0; i < ctx->max_threads; i++) {
+            w = &pool->workers[i];
+            nodes     += w->num_nodes;
+            solutions += w->num_solutions;
+            tasks     += w->num_tasks;
+            steals    += w->num_steals;
+            cache_hits   += w->cache_hits;
+            cache_misses += w->cache_misses;
+            passes    += w->strategy_stats[STRATEGY_NAKED_SINGLES].calls;
+            for (j = 0; j < MAX_STRATEGY; j++) {
+                backtracks += w->strategy_stats[j].contradictions;
+            }
+        }
+
+        // format the JSON line, and write it
+        len = snprintf(buff, max,
+                       "{\"t_ms\":%ld,\"running\":%s,\"solutions\":%ld,\"nodes\":%ld,"
+                       "\"nodes_per_sec\":%ld,\"passes\":%ld,\"backtracks\":%ld,"
+                       "\"tasks\":%ld,\"steals\":%ld,\"cache_hits\":%ld,\"cache_misses\":%ld,"
+                       "\"workers\":[",
+                       (now - pool->create_us) / 1000,
+                       (pool->num_waiting == ctx->max_threads ? "false" : "true"),
+                       solutions, nodes, 
+                       (nodes - prior_nodes) * 1000000L / (now - prior_us + 1),
+                       passes, backtracks, tasks, steals, cache_hits, cache_misses);
+        for (i = 0; i < ctx->max_threads; i++) {
+            w = &pool->workers[i];
+            metrics_worker_busy(w, now, &busy);
+            depth = w->deque_bottom - w->deque_top;
+            len += snprintf(buff+len, max-len, 
+                            "%s{\"id\":%d,\"nodes\":%ld,\"steals\":%ld,\"deque\":%ld,\"util\":%.2f}",
+                            (i ? "," : ""), i, w->num_nodes, w->num_steals, depth,
+                            (double)(busy - prior_busy[i]) / (now - prior_us + 1));
+            prior_busy[i] = busy;
+        }
+        len += snprintf(buff+len, max-len, "]}\n");
+        if (write(ctx->metrics_fd, buff, len) != len) {
+            snprintf(ctx->error, sizeof(ctx->error), "failed to write metrics, %s", 
+                     strerror(errno));
+            pthread_mutex_lock(&pool->mutex);
+            break;
+        }
+        prior_us = now;
+        prior_nodes = nodes;
+
+        pthread_mutex_lock(&pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    free(buff);
+    free(prior_busy);
+    return NULL;
+}
+
+static void metrics_create(sudoku_ctx_t * ctx)
+{
+    pool_t * pool = ctx->pool;
+
+    pthread_cond_init(&pool->metrics_cond, NULL);
+    pthread_create(&pool->metrics_thread_id, NULL, metrics_thread, ctx);
+}
+
+static void metrics_destroy(sudoku_ctx_t * ctx)
+{
+    pool_t * pool = ctx->pool;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->metrics_shutdown = true;
+    pthread_cond_broadcast(&pool->metrics_cond);
+    pthread_mutex_unlock(&pool->mutex);
+    pthread_join(pool->metrics_thread_id, NULL);
+    pthread_cond_destroy(&pool->metrics_cond);
+}
+
+// -----------------  CHECKPOINT  ----------------------------------
+
+// A checkpoint is the frontier of a solve, the branch states not yet searched,
+// along with its counters. It is written when the run is stopped by a
+// checkpoint request, or by cancel, or when the run completes; the branch 
+// states are then saved in the worker frontiers, and are gathered in the 
+// pool's frontier, from which the next run is started.
+//
+// The checkpoint file is:
+// - checkpoint_hdr_t: the puzzle, the first solution, the number of solutions,
+//   and the nodes examined and time spent
+// - the branch states, max_frontier packed records; a branch state is just 
+//   its values, as the possible values of its locations are determined from them
+//
+// It is written to a temporary file, which is renamed; so a checkpoint file 
+// is always complete, also when the program is stopped while writing it. 
+// When resumed all that is needed of a branch state is its values, so the 
+// solve can be resumed with a different engine, or number of threads.
+
+typedef struct {
+    char     magic[8];                  // CHECKPOINT_MAGIC
+    uint32_t version;                   // CHECKPOINT_VERSION
+    uint32_t rec_size;                  // PACKED_SIZE
+    uint64_t num_solutions;
+    uint64_t num_nodes;
+    uint64_t duration_us;
+    uint64_t max_frontier;              // number of branch states that follow
+    uint8_t  puzzle[PACKED_SIZE];
+    uint8_t  solution[PACKED_SIZE];     // the first solution, when the solutions were not counted
+    uint8_t  pad[6];
+} checkpoint_hdr_t;
+
+static void frontier_add(worker_t * w, board_t * b)
+{
+    // when the job is checkpointed, save the branch state in the worker's frontier
+    if (!w->job->checkpoint) {
+        return;
+    }
+    if (w->max_frontier == w->frontier_alloc) {
+        w->frontier_alloc = (w->frontier_alloc == 0 ? 1024 : 2 * w->frontier_alloc);
+        w->frontier = realloc(w->frontier, w->frontier_alloc * sizeof(puzzle_t));
+        if (w->frontier == NULL) {
+            printf("ERROR: failed to allocate frontier\n");
+            exit(1);
+        }
+    }
+    w->frontier[w->max_frontier++] = b->p;
+}
+
+static void frontier_alloc(sudoku_ctx_t * ctx, uint64_t n)
+{
+    pool_t * pool = ctx->pool;
+
+    // allocate the pool's frontier for n branch states
+    if (n > pool->frontier_alloc) {
+        pool->frontier_alloc = n;
+        pool->frontier = realloc(pool->frontier, n * sizeof(puzzle_t));
+        if (pool->frontier == NULL) {
+            printf("ERROR: failed to allocate frontier\n");
+            exit(1);
+        }
+    }
+}
+
+static void checkpoint_hdr_init(checkpoint_hdr_t * hdr, puzzle_t * puzzle, puzzle_t * solution,
+                                uint64_t num_solutions, uint64_t num_nodes, uint64_t duration_us,
+                                uint64_t max_frontier)
+{
+    memset(hdr, 0, sizeof(checkpoint_hdr_t));
+    memcpy(hdr->magic, CHECKPOINT_MAGIC, sizeof(hdr->magic));
+    hdr->version       = CHECKPOINT_VERSION;
+    hdr->rec_size      = PACKED_SIZE;
+    hdr->num_solutions = num_solutions;
+    hdr->num_nodes     = num_nodes;
+    hdr->duration_us   = duration_us;
+    hdr->max_frontier  = max_frontier;
+    sudoku_pack(puzzle, 0, hdr->puzzle);
+    sudoku_pack(solution, 0, hdr->solution);
+}
+
+static bool checkpoint_file_write(sudoku_ctx_t * ctx, uint8_t * buff, uint64_t len)
+{
+    char    tmp_file[PATH_MAX];
+    int     fd, err;
+    ssize_t n;
+
+    // write the temporary file, and rename it to the checkpoint file; 
+    // buff is the header, followed by the branch states; on failure the 
+    // temporary file is removed, and the checkpoint file is unchanged
+    snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", ctx->checkpoint_file);
+    fd = open(tmp_file, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if (fd < 0) {
+        snprintf(ctx->error, sizeof(ctx->error), "failed to write checkpoint %s, %s", 
+                 ctx->checkpoint_file, strerror(errno));
+        return false;
+    }
+    n = write(fd, buff, len);
+    err = (n < 0 ? errno : n != len ? ENOSPC : fsync(fd) < 0 ? errno : 0);
+    if (close(fd) < 0 && err == 0) {
+        err = errno;
+    }
+    if (err == 0 && rename(tmp_file, ctx->checkpoint_file) < 0) {
+        err = errno;
+    }
+    if (err != 0) {
+        unlink(tmp_file);
+        snprintf(ctx->error, sizeof(ctx->error), "failed to write checkpoint %s, %s", 
+                 ctx->checkpoint_file, strerror(err));
+        return false;
+    }
+
+    ctx->stats.num_checkpoints++;
+    ctx->stats.checkpoint_states = ((checkpoint_hdr_t*)buff)->max_frontier;
+    return true;
+}
+
+static bool checkpoint_write(sudoku_ctx_t * ctx, job_t * job)
+{
+    pool_t         * pool = ctx->pool;
+    checkpoint_hdr_t hdr;
+    worker_t       * w;
+    uint8_t        * buff;
+    uint64_t         i, n, len, nodes;
+    bool             ok;
+
+    // gather the worker frontiers in the pool's frontier, the next run is 
+    // started from it; and sum the nodes examined by the job
+    n = nodes = 0;
+    for (i = 0; i < ctx->max_threads; i++) {
+        n += pool->workers[i].max_frontier;
+    }
+    frontier_alloc(ctx, n);
+    pool->max_frontier = pool->frontier_next = 0;
+    for (i = 0; i < ctx->max_threads; i++) {
+        w = &pool->workers[i];
+        memcpy(&pool->frontier[pool->max_frontier], w->frontier, w->max_frontier * sizeof(puzzle_t));
+        pool->max_frontier += w->max_frontier;
+        w->max_frontier = 0;
+        nodes += w->num_nodes;
+    }
+
+    // the header; the nodes and duration are those of the job, which are the 
+    // context's totals less those at the start of the job
+    checkpoint_hdr_init(&hdr, &job->puzzle, &job->solution, job->num_solutions,
+                        job->prior_nodes + nodes - job->start_nodes,
+                        job->prior_us + ctx->stats.duration_us - job->start_us,
+                        pool->max_frontier);
+
+    // pack the branch states
+    len = sizeof(hdr) + pool->max_frontier * PACKED_SIZE;
+    buff = malloc(len);
+    if (buff == NULL) {
+        printf("ERROR: failed to allocate checkpoint buffer\n");
+        exit(1);
+    }
+    memcpy(buff, &hdr, sizeof(hdr));
+    for (i = 0; i < pool->max_frontier; i++) {
+        sudoku_pack(&pool->frontier[i], 0, buff + sizeof(hdr) + i * PACKED_SIZE);
+    }
+
+    // write the checkpoint file
+    ok = checkpoint_file_write(ctx, buff, len);
+    free(buff);
+    return ok;
+}
+
+static bool checkpoint_read(sudoku_ctx_t * ctx, job_t * job)
+{
+    pool_t         * pool = ctx->pool;
+    checkpoint_hdr_t hdr;
+    puzzle_t         puzzle;
+    board_t          b;
+    uint8_t          rec[PACKED_SIZE];
+    uint64_t         i;
+    FILE           * fp;
+    bool             ok;
+
+    // read the header, and init the job from it
+    fp = fopen(ctx->checkpoint_file, "r");
+    if (fp == NULL) {
+        snprintf(ctx->error, sizeof(ctx->error), "failed to open checkpoint file, %s", strerror(errno));
+        return false;
+    }
+    ok = (fread(&hdr, sizeof(hdr), 1, fp) == 1 &&
+          memcmp(hdr.magic, CHECKPOINT_MAGIC, sizeof(hdr.magic)) == 0 &&
+          hdr.version == CHECKPOINT_VERSION && hdr.rec_size == PACKED_SIZE);
+    ok = ok && sudoku_unpack(hdr.puzzle, &puzzle);
+    if (ok) {
+        job_init(ctx, job, &puzzle, false);
+        ok = sudoku_unpack(hdr.solution, &job->solution);
+        job->from_frontier = true;
+        job->num_solutions = hdr.num_solutions;
+        job->num_reserved  = hdr.num_solutions;
+        job->prior_nodes   = hdr.num_nodes;
+        job->prior_us      = hdr.duration_us;
+    }
+
+    // read the branch states into the pool's frontier, the first run is started from it
+    if (ok) {
+        frontier_alloc(ctx, hdr.max_frontier);
+    }
+    for (i = 0; ok && i < hdr.max_frontier; i++) {
+        ok = (fread(rec, PACKED_SIZE, 1, fp) == 1 && 
+              sudoku_unpack(rec, &pool->frontier[i]) && 
+              board_init(&b, &pool->frontier[i]));
+    }
+    fclose(fp);
+    if (!ok) {
+        snprintf(ctx->error, sizeof(ctx->error), "checkpoint file is invalid");
+        return false;
+    }
+    pool->max_frontier  = hdr.max_frontier;
+    pool->frontier_next = 0;
+    return true;
+}
+
+// -----------------  SYMMETRY COUNT  ------------------------------
+
+// sudoku_count_symmetric counts the solutions of a puzzle using the symmetries
+// that map the puzzle to itself, and act freely on its solutions (no solution
+// is mapped to itself, except by the identity); so each orbit of solutions 
+// has the group's size, and the count is the group size times the number of 
+// orbits. One solution of each orbit, its canonical representative, is 
+// counted; the symmetries are:
+//
+// - relabeling the k digits that are absent from the givens, k! relabelings: 
+//   every digit is in each unit, so a relabeling changes every solution; the
+//   representative has the absent digits in increasing order in a unit U
+// - swapping stacks 1 and 2, when the givens are unchanged by the swap: rows
+//   have distinct digits, so the swap changes every solution; the 
+//   representative has the value at r0c3 less than at r0c6 (for 9x9, the
+//   first columns of the stacks)
+// - likewise swapping bands 1 and 2, with the value at r3c0 less than at r6c0
+//
+// U is a unit that the swaps used do not move, so the relabeling that makes 
+// an orbit's solution canonical is the same for each of the swaps; the 
+// combined group, of size k! times 2 for each swap, acts freely, and each
+// orbit has one solution that is canonical in all three respects. For the 
+// empty puzzle, U is box 0, and fixing it is the usual fix of the first box.
+//
+// The canonical representatives are counted by searching from a frontier of
+// branch states, one for each assignment of the absent digits to the blank 
+// locations of U, in increasing order; and of the ordered pairs of values 
+// at r0c3, r0c6 and r3c0, r6c0, when the swaps are used. U is chosen as the
+// unit with the fewest blank locations, for the fewest branch states.
+
+static bool symmetry_swap_invariant(puzzle_t * p, bool stacks)
+{
+    uint32_t r, c, other;
+
+    // return true if the givens are unchanged by swapping stacks 1 and 2,
+    // or bands 1 and 2
+    for (r = 0; r < MAX_VALUE; r++) {
+        for (c = 0; c < MAX_VALUE; c++) {
+            other = (stacks ? r * MAX_VALUE + (c / BOX_SIZE == 2 ? c - BOX_SIZE : c / BOX_SIZE == 1 ? c + BOX_SIZE : c)
+                            : (r / BOX_SIZE == 2 ? r - BOX_SIZE : r / BOX_SIZE == 1 ? r + BOX_SIZE : r) * MAX_VALUE + c);
+            if (p->value[r * MAX_VALUE + c] != p->value[other]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void symmetry_add(sudoku_ctx_t * ctx, puzzle_t * p, bool stack_swap, bool band_swap)
+{
+    pool_t * pool = ctx->pool;
+    uint32_t loc_a, loc_b, a, b;
+    puzzle_t q;
+    board_t  board;
+
+    // when a swap is used, add the branch states for each pair of values 
+    // a < b at its locations, r0c3 and r0c6 for the stack swap, and r3c0
+    // and r6c0 for the band swap
+    if (stack_swap || band_swap) {
+        loc_a = (stack_swap ? BOX_SIZE : BOX_SIZE * MAX_VALUE);
+        loc_b = 2 * loc_a;
+        for (a = 1; a <= MAX_VALUE; a++) {
+            for (b = a + 1; b <= MAX_VALUE; b++) {
+                q = *p;
+                q.value[loc_a] = a;
+                q.value[loc_b] = b;
+                q.num_no_value -= 2;
+                symmetry_add(ctx, &q, false, stack_swap && band_swap);
+            }
+        }
+        return;
+    }
+
+    // add the branch state to the pool's frontier, if no value is used 
+    // more than once in a unit
+    if (!board_init(&board, p)) {
+        return;
+    }
+    if (pool->max_frontier == pool->frontier_alloc) {
+        frontier_alloc(ctx, pool->frontier_alloc == 0 ? 1024 : 2 * pool->frontier_alloc);
+    }
+    pool->frontier[pool->max_frontier++] = *p;
+}
+
+int64_t sudoku_count_symmetric(sudoku_ctx_t * ctx, puzzle_t * puzzle)
+{
+    pool_t * pool = ctx->pool;
+    uint32_t locidx, unit, best_unit, best_blank, absent, k, i, n, set, blank[MAX_VALUE], num_blank;
+    uint64_t factor;
+    bool     stack_swap, band_swap, fixed;
+    mask_t   present = 0;
+    puzzle_t q;
+    job_t    job;
+    int64_t  num, total;
+
+    // the digits absent from the givens, and the swaps that leave the givens unchanged
+    for (locidx = 0; locidx < MAX_LOC; locidx++) {
+        if (puzzle->value[locidx] != NO_VALUE) {
+            present |= (1 << puzzle->value[locidx]);
+        }
+    }
+    absent = ~present & ALL_VALUES;
+    k = __builtin_popcount(absent);
+
+    // the group size, k!, would not fit in 64 bits when more than 20 digits
+    // are absent; nor would the count of a puzzle that has a solution
+    if (k > 20) {
+        snprintf(ctx->error, sizeof(ctx->error), "too many digits are absent, the count would overflow");
+        return -1;
+    }
+    stack_swap = symmetry_swap_invariant(puzzle, true);
+    band_swap  = symmetry_swap_invariant(puzzle, false);
+
+    // choose U, the unit with the fewest blank locations of those not moved 
+    // by the swaps: with the stack swap these are the columns and boxes of
+    // stack 0, with the band swap the rows and boxes of band 0
+    best_unit = best_blank = -1;
+    for (unit = 0; unit < MAX_UNIT; unit++) {
+        num_blank = 0;
+        fixed = true;
+        for (i = 0; i < MAX_VALUE; i++) {
+            locidx = unit_locs[unit][i];
+            num_blank += (puzzle->value[locidx] == NO_VALUE);
+            fixed = fixed && (!stack_swap || COL(locidx) < BOX_SIZE) && (!band_swap || ROW(locidx) < BOX_SIZE);
+        }
+        if (fixed && num_blank < best_blank) {
+            best_unit = unit;
+            best_blank = num_blank;
+        }
+    }
+    for (i = 0, num_blank = 0; i < MAX_VALUE; i++) {
+        locidx = unit_locs[best_unit][i];
+        if (puzzle->value[locidx] == NO_VALUE) {
+            blank[num_blank++] = locidx;
+        }
+    }
+
+    // the frontier is a branch state for each subset of k of U's blank 
+    // locations, with the absent digits set in increasing order, and with
+    // the ordered values of the swap locations
+    pool->max_frontier = pool->frontier_next = 0;
+    for (set = 0; set < (1U << num_blank); set++) {
+        if (__builtin_popcount(set) != k) {
+            continue;
+        }
+        q = *puzzle;
+        for (i = 0, n = absent; i < num_blank; i++) {
+            if (set & (1 << i)) {
+                q.value[blank[i]] = __builtin_ctz(n);
+                q.num_no_value--;
+                n &= n - 1;
+            }
+        }
+        symmetry_add(ctx, &q, stack_swap, band_swap);
+    }
+
+    // the size of the symmetry group
+    for (factor = 1, i = 2; i <= k; i++) {
+        factor *= i;
+    }
+    factor <<= (stack_swap + band_swap);
+    ctx->stats.symmetry_factor = factor;
+    ctx->stats.symmetry_states = pool->max_frontier;
+
+    // count the canonical representatives, and multiply by the group size;
+    // a puzzle which uses a value more than once in a unit has no solution,
+    // and a branch state may have no solution;
+    // when few givens remain, as for the empty grid, the product does not
+    // fit in 64 bits, and it is an error
+    job_init(ctx, &job, puzzle, true);
+    job.max_solutions = MAX_SOLUTIONS_INFINITE;
+    job.checkpoint    = false;
+    job.from_frontier = true;
+    num = solve(ctx, &job, NULL);
+    if (num < 0) {
+        return -1;
+    }
+    if (factor > INT64_MAX || __builtin_mul_overflow(num, (int64_t)factor, &total)) {
+        snprintf(ctx->error, sizeof(ctx->error), "the count overflows 64 bits, %ld canonical solutions "
+                 "times a symmetry factor of %lu", num, factor);
+        return -1;
+    }
+    ctx->stats.total_solutions += total - num;
+    return total;
+}
+
+// -----------------  DISTRIBUTED COUNT  ---------------------------
+
+// These are used to spread a count over processes, on other machines, see
+// the distributed mode of sudoku.c. The puzzle's search is expanded to a
+// depth, serially, into a frontier of branch states; the branch states are
+// counted in shards, by sudoku_count_states, which starts a count from them 
+// as does a resumed checkpoint; and the count of the branch states not yet
+// counted is checkpointed in the checkpoint file format, so it can be 
+// resumed, distributed or not.
+
+static void expand(worker_t * w, board_t * b, uint32_t depth, uint64_t * num_solutions)
+{
+    sudoku_ctx_t * ctx = w->ctx;
+    pool_t * pool = w->pool;
+    uint32_t best_num_pv, best_locidx=-1, best_pv=-1;
+    uint8_t  trial_val;
+    int32_t  rc;
+
+    // propagate, and if there is no solution then return; if found a 
+    // solution then count it, and return
+    w->num_nodes++;
+    rc = propagate(w, b, &best_locidx, &best_pv, &best_num_pv);
+    if (rc < 0) {
+        return;
+    }
+    if (rc == 0) {
+        (*num_solutions)++;
+        return;
+    }
+
+    // if the branch state is at the depth then add it to the pool's frontier,
+    // else expand each of the branch states of the location with the least
+    // number of possible values
+    if (b->depth >= depth) {
+        if (pool->max_frontier == pool->frontier_alloc) {
+            frontier_alloc(ctx, pool->frontier_alloc == 0 ? 1024 : 2 * pool->frontier_alloc);
+        }
+        pool->frontier[pool->max_frontier++] = b->p;
+        return;
+    }
+    for (trial_val = 1; trial_val <= MAX_VALUE; trial_val++) { 
+        if (best_pv & (1 << trial_val)) {
+            board_t child = *b;
+            board_set(&child, best_locidx, trial_val);
+            child.depth++;
+            expand(w, &child, depth, num_solutions);
+        }
+    }
+}
+
+int64_t sudoku_expand(sudoku_ctx_t * ctx, puzzle_t * puzzle, uint32_t depth, uint8_t ** recs, uint64_t * num_recs)
+{
+    pool_t   * pool = ctx->pool;
+    worker_t * w = &pool->workers[0];
+    uint64_t   num_solutions = 0, i, start_us;
+    job_t      job;
+    board_t    b;
+
+    // expand the search of the puzzle to the depth, on the calling thread 
+    // using worker 0, which is waiting for a run
+    *recs = NULL;
+    *num_recs = 0;
+    if (!board_init(&b, puzzle)) {
+        return 0;
+    }
+    job_init(ctx, &job, puzzle, true);
+    job.checkpoint = false;
+    start_us = microsec_timer();
+    pool->max_frontier = pool->frontier_next = 0;
+    w->job = &job;
+    expand(w, &b, depth, &num_solutions);
+    w->job = NULL;
+    ctx->stats.duration_us += microsec_timer() - start_us;
+
+    // pack the branch states of the frontier
+    *recs = malloc(pool->max_frontier * PACKED_SIZE + 1);
+    if (*recs == NULL) {
+        printf("ERROR: failed to allocate expanded branch states\n");
+        exit(1);
+    }
+    for (i = 0; i < pool->max_frontier; i++) {
+        sudoku_pack(&pool->frontier[i], 0, *recs + i * PACKED_SIZE);
+    }
+    *num_recs = pool->max_frontier;
+    pool->max_frontier = 0;
+
+    ctx->stats.total_solutions += num_solutions;
+    stats_update(ctx);
+    return num_solutions;
+}
+
+int64_t sudoku_count_states(sudoku_ctx_t * ctx, uint8_t * recs, uint64_t num_recs)
+{
+    pool_t * pool = ctx->pool;
+    board_t  b;
+    job_t    job;
+    uint64_t i;
+
+    // unpack the branch states into the pool's frontier
+    if (num_recs == 0) {
+        return 0;
+    }
+    frontier_alloc(ctx, num_recs);
+    for (i = 0; i < num_recs; i++) {
+        if (!sudoku_unpack(recs + i * PACKED_SIZE, &pool->frontier[i]) || !board_init(&b, &pool->frontier[i])) {
+            snprintf(ctx->error, sizeof(ctx->error), "record %ld is invalid", i + 1);
+            return -1;
+        }
+    }
+    pool->max_frontier  = num_recs;
+    pool->frontier_next = 0;
+
+    // count the solutions of the branch states, the job's puzzle is the first
+    job_init(ctx, &job, &pool->frontier[0], true);
+    job.max_solutions = MAX_SOLUTIONS_INFINITE;
+    job.checkpoint    = false;
+    job.from_frontier = true;
+    return solve(ctx, &job, NULL);
+}
+
+int sudoku_checkpoint_states(sudoku_ctx_t * ctx, puzzle_t * puzzle, uint64_t num_solutions, 
+                             uint64_t num_nodes, uint64_t duration_us, uint8_t * recs, uint64_t num_recs)
+{
+    checkpoint_hdr_t hdr;
+    puzzle_t         solution;
+    uint8_t        * buff;
+    uint64_t         len;
+    bool             ok;
+
+    // write the checkpoint file, the header followed by the branch states
+    if (ctx->checkpoint_file == NULL) {
+        snprintf(ctx->error, sizeof(ctx->error), "checkpoint file is not set");
+        return -1;
+    }
+    memset(&solution, NO_VALUE, sizeof(solution));
+    checkpoint_hdr_init(&hdr, puzzle, &solution, num_solutions, num_nodes, duration_us, num_recs);
+    len = sizeof(hdr) + num_recs * PACKED_SIZE;
+    buff = malloc(len);
+    if (buff == NULL) {
+        printf("ERROR: failed to allocate checkpoint buffer\n");
+        exit(1);
+    }
+    memcpy(buff, &hdr, sizeof(hdr));
+    memcpy(buff + sizeof(hdr), recs, num_recs * PACKED_SIZE);
+    ok = checkpoint_file_write(ctx, buff, len);
+    free(buff);
+    return (ok ? 0 : -1);
+}
+
+int64_t sudoku_checkpoint_read_states(sudoku_ctx_t * ctx, puzzle_t * puzzle, uint8_t ** recs, uint64_t * num_recs)
+{
+    pool_t * pool = ctx->pool;
+    job_t    job;
+    uint64_t i;
+
+    // read the checkpoint into the job and the pool's frontier, and pack the
+    // frontier's branch states
+    if (ctx->checkpoint_file == NULL) {
+        snprintf(ctx->error, sizeof(ctx->error), "checkpoint file is not set");
+        return -1;
+    }
+    if (!checkpoint_read(ctx, &job)) {
+        return -1;
+    }
+    *recs = malloc(pool->max_frontier * PACKED_SIZE + 1);
+    if (*recs == NULL) {
+        printf("ERROR: failed to allocate checkpoint branch states\n");
+        exit(1);
+    }
+    for (i = 0; i < pool->max_frontier; i++) {
+        sudoku_pack(&pool->frontier[i], 0, *recs + i * PACKED_SIZE);
+    }
+    *num_recs = pool->max_frontier;
+    *puzzle = job.puzzle;
+    pool->max_frontier = 0;
+    return job.num_solutions;
+}
+
+// -----------------  BATCH  ---------------------------------------
+
+// Batch input format ...
+//
+// One puzzle per line, MAX_LOC chars (81 for 9x9), in row order, with '.' or
+// '0' for blank locations; see SUDOKU_VALUE_CHAR for the values past 9. Blank 
+// lines and lines beginning with '#' are skipped.
+//
+// For each puzzle the first solution is output, in the same format; a 
+// puzzle that has no solution is output as MAX_LOC '.' chars. When max_solutions
+// is not 1 the line also has the number of solutions found.
+//
+// When the input_format, or output_format, is packed the input, or output,
+// is packed records, see PACKED FORMAT below.
+//
+// The puzzles are parsed in place. The input is solved a window at a time;
+// the window is divided into chunks, which begin at the start of a puzzle.
+// The chunks are about BATCH_CHUNK_SIZE, or smaller when the window is small,
+// so there are at least 4 chunks per worker thread, and a small batch is 
+// solved by all the workers; but not less than BATCH_MIN_CHUNK_SIZE, and not
+// more than BATCH_WINDOW_CHUNKS per window. The workers claim the chunks, and parse and 
+// solve the chunk's puzzles, writing the results in the chunk's out buffer.
+// When the window is done the chunk results are given to the batch_cb, in
+// order. A worker that finds an invalid puzzle stops solving its chunk, and
+// the results up to the invalid puzzle are given to the batch_cb.
+
+char * sudoku_batch_boundary(sudoku_ctx_t * ctx, char * start, char * s, char * end)
+{
+    // return the first boundary between puzzles at or after s, but not
+    // beyond end; for text input this is the start of a line, for packed
+    // input it is a multiple of PACKED_SIZE from start
+    if (s >= end) {
+        return end;
+    }
+    if (ctx->input_format == FORMAT_PACKED) {
+        return start + (s - start + PACKED_SIZE - 1) / PACKED_SIZE * PACKED_SIZE;
+    }
+    s = memchr(s, '\n', end - s);
+    return (s == NULL ? end : s + 1);
+}
+
+static void batch_error(sudoku_ctx_t * ctx, char * s)
+{
+    pool_t * pool = ctx->pool;
+    char   * p;
+
+    // set the error, with the line number, or record number, of the
+    // invalid puzzle at s
+    if (ctx->input_format == FORMAT_PACKED) {
+        ctx->error_pos = (s - pool->batch_input) / PACKED_SIZE + 1;
+        snprintf(ctx->error, sizeof(ctx->error), "record %ld is invalid", ctx->error_pos);
+    } else {
+        ctx->error_pos = 1;
+        for (p = pool->batch_input; (p = memchr(p, '\n', s - p)) != NULL; p++) {
+            ctx->error_pos++;
+        }
+        snprintf(ctx->error, sizeof(ctx->error), "line %ld is invalid", ctx->error_pos);
+    }
+}
+
+static bool batch_window(sudoku_ctx_t * ctx, char * start, char * end)
+{
+    pool_t * pool = ctx->pool;
+    uint32_t i;
+    size_t   size;
+    char   * s, * nl;
+
+    // divide the window into chunks, each chunk begins at the start of a puzzle
+    size = (end - start) / (4 * ctx->max_threads);
+    size = (size > BATCH_CHUNK_SIZE ? BATCH_CHUNK_SIZE : size < BATCH_MIN_CHUNK_SIZE ? BATCH_MIN_CHUNK_SIZE : size);
+    if (size < (end - start) / BATCH_WINDOW_CHUNKS + 1) {
+        size = (end - start) / BATCH_WINDOW_CHUNKS + 1;
+    }
+    pool->max_batch_chunks = 0;
+    for (s = start; s < end; s = nl) {
+        chunk_t * c = &pool->batch_chunks[pool->max_batch_chunks++];
+        nl = sudoku_batch_boundary(ctx, start, s + size, end);
+        c->start = s;
+        c->end   = nl;
+    }
+
+    // solve the window's chunks
+    pool->batch_next = 0;
+    pool_run(ctx, 0);
+    batch_slowest_ids(ctx);
+
+    // give the results to the batch_cb, in input order, and keep track
+    // of the stats; return false if a chunk has an invalid puzzle
+    for (i = 0; i < pool->max_batch_chunks; i++) {
+        chunk_t * c = &pool->batch_chunks[i];
+        if (ctx->batch_cb) {
+            ctx->batch_cb(ctx, c->out, c->out_len);
+        }
+        ctx->stats.num_puzzles     += c->num_puzzles;
+        ctx->stats.num_solved      += c->num_solved;
+        ctx->stats.total_solutions += c->num_solutions;
+        if (c->error) {
+            batch_error(ctx, c->error);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void batch_chunks_alloc(sudoku_ctx_t * ctx)
+{
+    pool_t * pool = ctx->pool;
+    uint32_t i;
+
+    // allocate the chunks, the size of a chunk's out buffer allows for 
+    // its lines to be longer than BATCH_CHUNK_SIZE, because a chunk ends
+    // at the start of a line
+    if (pool->batch_chunks == NULL) {
+        pool->batch_chunks = calloc(BATCH_WINDOW_CHUNKS + 1, sizeof(chunk_t));
+        if (pool->batch_chunks == NULL) {
+            printf("ERROR: failed to allocate batch chunks\n");
+            exit(1);
+        }
+        for (i = 0; i < BATCH_WINDOW_CHUNKS + 1; i++) {
+            pool->batch_chunks[i].out = malloc((2 * BATCH_CHUNK_SIZE / MAX_LOC + 2) * BATCH_MAX_OUT_LINE);
+            if (pool->batch_chunks[i].out == NULL) {
+                printf("ERROR: failed to allocate batch chunks\n");
+                exit(1);
+            }
+        }
+    }
+}
+
+int64_t sudoku_solve_batch(sudoku_ctx_t * ctx, char * input, size_t len)
+{
+    pool_t * pool = ctx->pool;
+    uint64_t num_puzzles = ctx->stats.num_puzzles;
+    char   * s, * end;
+    bool     ok = true;
+
+    // solve the input, a window at a time
+    batch_chunks_alloc(ctx);
+#ifdef VERIFY_SOLUTIONS
+    verify_reset(ctx);
+#endif
+    pool->batch_input = input;
+    for (s = input; s < input + len && ok && !ctx->cancel; s = end) {
+        end = sudoku_batch_boundary(ctx, input, s + BATCH_WINDOW_SIZE, input + len);
+        ok = batch_window(ctx, s, end);
+    }
+    stats_update(ctx);
+
+    return ok ? ctx->stats.num_puzzles - num_puzzles : -1;
+}
+
+static void batch_format_line(sudoku_ctx_t * ctx, job_t * job, char * out, size_t * out_len);
+
+static void batch_chunk(worker_t * w, chunk_t * c)
+{
+    sudoku_ctx_t * ctx = w->ctx;
+    char   * s, * nl, * out;
+    job_t    job;
+    uint64_t start_ns;
+
+    // parse and solve each of the chunk's puzzles, the results are
+    // written to the chunk's out buffer
+    c->out_len = c->num_puzzles = c->num_solved = c->num_solutions = 0;
+    c->error = NULL;
+    for (s = c->start; s < c->end && !ctx->cancel; s = nl + 1) {
+        memset(&job, 0, sizeof(job));
+        job.id = s - w->pool->batch_input + 1;
+        job.max_solutions = ctx->max_solutions;
+        if (ctx->input_format == FORMAT_PACKED) {
+            // unpack the puzzle record
+            nl = s + PACKED_SIZE - 1;
+            if (nl >= c->end || !sudoku_unpack((uint8_t*)s, &job.puzzle)) {
+                c->error = s;
+                break;
+            }
+        } else {
+            // find the end of the line, and skip blank and comment lines
+            nl = memchr(s, '\n', c->end - s);
+            if (nl == NULL) {
+                nl = c->end;
+            }
+            if (nl == s || (nl == s + 1 && s[0] == '\r') || s[0] == '#') {
+                continue;
+            }
+
+            // parse the puzzle line
+            if (!sudoku_parse_line(s, nl, &job.puzzle)) {
+                c->error = s;
+                break;
+            }
+        }
+
+        // find the puzzle's solutions
+        start_ns = nanosec_timer();
+        batch_solve_puzzle(w, &job);
+
+        // write the result
+        out = c->out + c->out_len;
+        if (ctx->output_format == FORMAT_PACKED) {
+            if (job.num_solutions == 0) {
+                memset(&job.solution, NO_VALUE, sizeof(job.solution.value));
+            }
+            sudoku_pack(&job.solution, job.num_solutions, (uint8_t*)out);
+            c->out_len += PACKED_SIZE;
+        } else {
+            batch_format_line(ctx, &job, out, &c->out_len);
+        }
+
+        // stats
+        batch_latency(w, c, nanosec_timer() - start_ns);
+        c->num_puzzles++;
+        c->num_solved += (job.num_solutions > 0);
+        c->num_solutions += job.num_solutions;
+    }
+    w->job = NULL;
+}
+
+static void batch_solve_puzzle(worker_t * w, job_t * job)
+{
+    board_t b;
+
+    // find the puzzle's solutions, or get them from the cache; a puzzle
+    // which uses a value more than once in a unit has no solution
+    w->job = job;
+    if (board_init(&b, &job->puzzle)) {
+#if BOX_SIZE == 3
+        if (w->pool->cache) {
+            cache_find_solutions(w, job, &b);
+        } else {
+            w->num_tasks++;
+            run_task(w, &b);
+        }
+#else
+        w->num_tasks++;
+        run_task(w, &b);
+#endif
+    }
+}
+
+static void batch_latency(worker_t * w, chunk_t * c, uint64_t ns)
+{
+    uint32_t i, idx, e;
+
+    // add the puzzle's time to the latency histogram; times less than
+    // 2^LATENCY_SUB_BITS ns have a bucket each, and each larger power of
+    // 2 has 2^LATENCY_SUB_BITS buckets, selected by the bits following 
+    // its most significant bit
+    if (ns < (1 << LATENCY_SUB_BITS)) {
+        idx = ns;
+    } else {
+        e = 63 - __builtin_clzll(ns);
+        idx = ((e - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) + 
+              ((ns >> (e - LATENCY_SUB_BITS)) & ((1 << LATENCY_SUB_BITS) - 1));
+    }
+    w->latency_hist[idx < MAX_LATENCY_HIST ? idx : MAX_LATENCY_HIST-1]++;
+
+    // when the puzzle is slower than one of the worker's slowest, it
+    // replaces the fastest of them; the puzzle is identified by its chunk,
+    // and its index in the chunk, until the chunk's first puzzle number is set;
+    // async requests, which have no chunk, are not kept
+    if (c == NULL || ns <= w->slowest_min_ns) {
+        return;
+    }
+    idx = 0;
+    for (i = 1; i < MAX_SLOWEST; i++) {
+        if (w->slowest[i].ns < w->slowest[idx].ns) {
+            idx = i;
+        }
+    }
+    w->slowest[idx].ns    = ns;
+    w->slowest[idx].id    = c->num_puzzles;
+    w->slowest[idx].chunk = c;
+    w->slowest_min_ns = ns;
+    for (i = 0; i < MAX_SLOWEST; i++) {
+        if (w->slowest[i].ns < w->slowest_min_ns) {
+            w->slowest_min_ns = w->slowest[i].ns;
+        }
+    }
+}
+
+static void batch_slowest_ids(sudoku_ctx_t * ctx)
+{
+    pool_t * pool = ctx->pool;
+    uint64_t first = ctx->stats.num_puzzles + 1;
+    uint32_t i, j;
+
+    // set the number of the first puzzle of each of the window's chunks, 
+    // and the puzzle numbers of the workers' slowest puzzles of the window
+    for (i = 0; i < pool->max_batch_chunks; i++) {
+        pool->batch_chunks[i].first = first;
+        first += pool->batch_chunks[i].num_puzzles;
+    }
+    for (i = 0; i < ctx->max_threads; i++) {
+        for (j = 0; j < MAX_SLOWEST; j++) {
+            slowest_t * e = &pool->workers[i].slowest[j];
+            if (e->chunk) {
+                e->id += e->chunk->first;
+                e->chunk = NULL;
+            }
+        }
+    }
+}
+
+uint64_t sudoku_latency_percentile(sudoku_stats_t * st, double percentile)
+{
+    uint64_t total = 0, target, n = 0;
+    uint32_t idx, e;
+
+    // find the bucket that has the percentile's puzzle, the puzzles are
+    // counted from the fastest
+    for (idx = 0; idx < MAX_LATENCY_HIST; idx++) {
+        total += st->latency_hist[idx];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    target = total * percentile / 100;
+    if (target < total * percentile / 100 || target == 0) {
+        target++;
+    }
+    for (idx = 0; idx < MAX_LATENCY_HIST-1; idx++) {
+        n += st->latency_hist[idx];
+        if (n >= target) {
+            break;
+        }
+    }
+
+    // return the upper bound of the bucket, see batch_latency
+    if (idx < (1 << LATENCY_SUB_BITS)) {
+        return idx;
+    }
+    e = (idx >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+    return ((uint64_t)((1 << LATENCY_SUB_BITS) + (idx & ((1 << LATENCY_SUB_BITS) - 1)) + 1)
+            << (e - LATENCY_SUB_BITS)) - 1;
+}
+
+static void batch_format_line(sudoku_ctx_t * ctx, job_t * job, char * out, size_t * out_len)
+{
+    uint32_t locidx;
+    
+    // format the batch result line, the solution and, when max_solutions is
+    // not 1, the number of solutions
+    for (locidx = 0; locidx < MAX_LOC; locidx++) {
+        out[locidx] = (job->num_solutions == 0 ? '.' : SUDOKU_VALUE_CHAR(job->solution.value[locidx]));
+    }
+    if (ctx->max_solutions == 1) {
+        out[MAX_LOC] = '\n';
+        *out_len += MAX_LOC + 1;
+    } else {
+        *out_len += MAX_LOC + sprintf(out+MAX_LOC, " %ld\n", job->num_solutions);
+    }
+}
+
+bool sudoku_parse_line(char * s, char * end, puzzle_t * p)
+{
+    uint32_t locidx;
+    char     c;
+
+    // parse the MAX_LOC chars of a batch puzzle line, which may be followed by 
+    // white space; end is the end of the line; return false if the line is invalid
+    if (end - s < MAX_LOC) {
+        return false;
+    }
+    p->num_no_value = MAX_LOC;
+    for (locidx = 0; locidx < MAX_LOC; locidx++) {
+        c = s[locidx];
+        if (c == '.' || c == '0') {
+            p->value[locidx] = NO_VALUE;
+        } else if (SUDOKU_CHAR_VALUE(c) != 0) {
+            p->value[locidx] = SUDOKU_CHAR_VALUE(c);
+            p->num_no_value--;
+        } else {
+            return false;
+        }
+    }
+    for (s += MAX_LOC; s < end; s++) {
+        if (*s != '\r' && *s != ' ' && *s != '\t') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// -----------------  ASYNC  ---------------------------------------
+
+// Async requests are solved by the worker pool while the caller continues,
+// for use by event loop services. sudoku_async_start starts a run which 
+// serves the requests until sudoku_async_stop; in the run the workers claim
+// the requests from the submission queue, and each request is solved by the
+// claiming worker as a batch puzzle, without pushing branch states on its 
+// deque. A completed request is pushed on the completion queue, and the 
+// eventfd is written, so the caller's event loop is woken to reap it.
+//
+// The submission and completion queues are bounded lock free MPMC queues: 
+// the cells have a sequence number, and a push, or pop, claims its position 
+// by advancing the head, or tail, with a compare and swap, and then publishes
+// the cell by setting its sequence number. At most ASYNC_QUEUE_SIZE requests
+// are in flight, submitted and not reaped; so a push to either queue always
+// has a free cell.
+//
+// A worker that finds no request waits on async_cond; a submit signals it 
+// when there are waiting workers, so idle workers do not spin. The submit
+// has a full barrier between its pushes and reading async_sleepers, and the
+// worker between incrementing async_sleepers and checking the queue is 
+// empty; without them the store and load can be reordered, the submit 
+// seeing no sleepers and the worker an empty queue, and the worker sleeps
+// with the request queued.
+//
+// A submit counts itself in async_submitting while it checks for stop and 
+// pushes; sudoku_async_stop sets ASYNC_STOPPING in it, so later submits are
+// refused, and waits for the submits in progress before stopping the 
+// workers; so a submitted request is not left in the queue. The eventfd
+// is written once until the next reap, rather than for each completion, 
+// using the async_notify flag: a worker sets it after pushing a completion,
+// and writes the eventfd when it was clear. A reap reads the eventfd, then
+// clears the flag, and then pops the completions; so a completion pushed 
+// after the pops finds the flag clear, and writes the eventfd. The eventfd is
+// read first so that a write made before the flag is cleared, by a worker
+// that found it clear, is not consumed after clearing it, which would leave
+// the flag set with the eventfd not readable.
+
+static void async_queue_init(async_queue_t * q)
+{
+    uint64_t i;
+
+    q->head = q->tail = 0;
+    for (i = 0; i < ASYNC_QUEUE_SIZE; i++) {
+        q->cell[i].seq = i;
+    }
+}
+
+static bool async_queue_push(async_queue_t * q, request_t * req)
+{
+    async_cell_t * cell;
+    uint64_t       pos = *(volatile uint64_t *)&q->head;
+    int64_t        diff;
+
+    // claim the head position, when its cell has been popped; return false
+    // if the queue is full
+    while (true) {
+        cell = &q->cell[pos & (ASYNC_QUEUE_SIZE-1)];
+        diff = (int64_t)(*(volatile uint64_t *)&cell->seq - pos);
+        if (diff == 0 && __sync_bool_compare_and_swap(&q->head, pos, pos+1)) {
+            break;
+        }
+        if (diff < 0) {
+            return false;
+        }
+        pos = *(volatile uint64_t *)&q->head;
+    }
+
+    // set the cell, and publish it to the pop of this position
+    cell->req = req;
+    __sync_synchronize();
+    cell->seq = pos + 1;
+    return true;
+}
+
+static request_t * async_queue_pop(async_queue_t * q)
+{
+    async_cell_t * cell;
+    request_t    * req;
+    uint64_t       pos = *(volatile uint64_t *)&q->tail;
+    int64_t        diff;
+
+    // claim the tail position, when its cell has been pushed; return NULL
+    // if the queue is empty
+    while (true) {
+        cell = &q->cell[pos & (ASYNC_QUEUE_SIZE-1)];
+        diff = (int64_t)(*(volatile uint64_t *)&cell->seq - (pos + 1));
+        if (diff == 0 && __sync_bool_compare_and_swap(&q->tail, pos, pos+1)) {
+            break;
+        }
+        if (diff < 0) {
+            return NULL;
+        }
+        pos = *(volatile uint64_t *)&q->tail;
+    }
+
+    // get the request, and free the cell for the push of the position a 
+    // lap later
+    req = cell->req;
+    __sync_synchronize();
+    cell->seq = pos + ASYNC_QUEUE_SIZE;
+    return req;
+}
+
+static bool async_queue_empty(async_queue_t * q)
+{
+    uint64_t pos = *(volatile uint64_t *)&q->tail;
+
+    return (int64_t)(*(volatile uint64_t *)&q->cell[pos & (ASYNC_QUEUE_SIZE-1)].seq - (pos + 1)) < 0;
+}
+
+int sudoku_async_start(sudoku_ctx_t * ctx)
+{
+    pool_t * pool = ctx->pool;
+
+    // allocate the queues, they are kept when serving is stopped, so the
+    // completed requests can be reaped
+    if (pool->async) {
+        snprintf(ctx->error, sizeof(ctx->error), "async is already started");
+        return -1;
+    }
+    if (pool->async_sq == NULL) {
+        pool->async_sq = aligned_alloc(64, sizeof(async_queue_t));
+        pool->async_cq = aligned_alloc(64, sizeof(async_queue_t));
+        if (pool->async_sq == NULL || pool->async_cq == NULL) {
+            printf("ERROR: failed to allocate async queues\n");
+            exit(1);
+        }
+        async_queue_init(pool->async_sq);
+        async_queue_init(pool->async_cq);
+    }
+    pool->async_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (pool->async_fd < 0) {
+        snprintf(ctx->error, sizeof(ctx->error), "failed to create eventfd, %s", strerror(errno));
+        return -1;
+    }
+
+    // start the run that serves the requests
+    pool->async_stop = false;
+    pool->async_submitting = 0;
+    pool->async = true;
+    pool_start(ctx);
+    return pool->async_fd;
+}
+
+void sudoku_async_stop(sudoku_ctx_t * ctx)
+{
+    pool_t * pool = ctx->pool;
+    worker_t * w;
+    uint32_t i;
+
+    // stop the run, after the requests submitted are completed
+    if (!pool->async) {
+        return;
+    }
+    __sync_fetch_and_or(&pool->async_submitting, ASYNC_STOPPING);
+    while (*(volatile uint32_t *)&pool->async_submitting != ASYNC_STOPPING) {
+        sched_yield();
+    }
+    pthread_mutex_lock(&pool->async_mutex);
+    pool->async_stop = true;
+    pthread_cond_broadcast(&pool->async_cond);
+    pthread_mutex_unlock(&pool->async_mutex);
+    pool_wait(ctx, 0);
+    pool->async = false;
+    close(pool->async_fd);
+    pool->async_fd = -1;
+
+    // keep track of the stats
+    for (i = 0; i < ctx->max_threads; i++) {
+        w = &pool->workers[i];
+        ctx->stats.num_puzzles     += w->async_puzzles;
+        ctx->stats.num_solved      += w->async_solved;
+        ctx->stats.total_solutions += w->async_solutions;
+        w->async_puzzles = w->async_solved = w->async_solutions = 0;
+    }
+    stats_update(ctx);
+}
+
+uint32_t sudoku_async_submit(sudoku_ctx_t * ctx, sudoku_request_t ** reqs, uint32_t n)
+{
+    pool_t * pool = ctx->pool;
+    uint32_t i;
+
+    // push the requests on the submission queue, while there are less than
+    // ASYNC_QUEUE_SIZE in flight; not when serving is stopped, or stopping
+    if (!pool->async) {
+        return 0;
+    }
+    if (__sync_add_and_fetch(&pool->async_submitting, 1) & ASYNC_STOPPING) {
+        __sync_sub_and_fetch(&pool->async_submitting, 1);
+        return 0;
+    }
+    for (i = 0; i < n; i++) {
+        if (__sync_add_and_fetch(&pool->async_inflight, 1) > ASYNC_QUEUE_SIZE) {
+            __sync_sub_and_fetch(&pool->async_inflight, 1);
+            break;
+        }
+        async_queue_push(pool->async_sq, reqs[i]);
+    }
+
+    // wake the workers waiting for a request, the barrier orders the pushes
+    // before reading async_sleepers
+    __sync_synchronize();
+    if (i > 0 && *(volatile uint32_t *)&pool->async_sleepers) {
+        pthread_mutex_lock(&pool->async_mutex);
+        if (i == 1) {
+            pthread_cond_signal(&pool->async_cond);
+        } else {
+            pthread_cond_broadcast(&pool->async_cond);
+        }
+        pthread_mutex_unlock(&pool->async_mutex);
+    }
+    __sync_sub_and_fetch(&pool->async_submitting, 1);
+    return i;
+}
+
+uint32_t sudoku_async_reap(sudoku_ctx_t * ctx, sudoku_request_t ** reqs, uint32_t max)
+{
+    pool_t * pool = ctx->pool;
+    request_t * req;
+    uint64_t v;
+    uint32_t n = 0;
+
+    // clear the eventfd, and the notify flag, and pop the completed requests
+    if (pool->async_cq == NULL) {
+        return 0;
+    }
+    if (pool->async_fd >= 0 && read(pool->async_fd, &v, sizeof(v)) < 0) {
+        // the eventfd is not readable, EAGAIN
+    }
+    __sync_fetch_and_and(&pool->async_notify, 0);
+    while (n < max && (req = async_queue_pop(pool->async_cq)) != NULL) {
+        reqs[n++] = req;
+    }
+    if (n > 0) {
+        __sync_sub_and_fetch(&pool->async_inflight, n);
+    }
+    return n;
+}
+
+static bool async_claim(worker_t * w)
+{
+    sudoku_ctx_t * ctx = w->ctx;
+    pool_t * pool = w->pool;
+    request_t * req;
+    job_t    job;
+    uint64_t start_ns, v = 1;
+
+    // claim the next submitted request; when there is none then wait for a
+    // request to be submitted, and return false when serving is stopped
+    if (!pool->async) {
+        return false;
+    }
+    while ((req = async_queue_pop(pool->async_sq)) == NULL) {
+        pthread_mutex_lock(&pool->async_mutex);
+        __sync_add_and_fetch(&pool->async_sleepers, 1);
+        w->busy_us += microsec_timer() - w->busy_since;
+        w->busy_since = 0;
+        while (async_queue_empty(pool->async_sq) && !pool->async_stop) {
+            pthread_cond_wait(&pool->async_cond, &pool->async_mutex);
+        }
+        w->busy_since = microsec_timer();
+        __sync_sub_and_fetch(&pool->async_sleepers, 1);
+        pthread_mutex_unlock(&pool->async_mutex);
+        if (pool->async_stop && async_queue_empty(pool->async_sq)) {
+            return false;
+        }
+    }
+
+    // find the request's solutions, as a batch puzzle
+    start_ns = nanosec_timer();
+    memset(&job, 0, sizeof(job));
+    job.id = __sync_add_and_fetch(&pool->async_next_id, 1);
+    job.max_solutions = ctx->max_solutions;
+    job.puzzle = req->puzzle;
+    batch_solve_puzzle(w, &job);
+    w->job = NULL;
+    req->solution = job.solution;
+    req->num_solutions = job.num_solutions;
+    batch_latency(w, NULL, nanosec_timer() - start_ns);
+    w->async_puzzles++;
+    w->async_solved += (job.num_solutions > 0);
+    w->async_solutions += job.num_solutions;
+
+    // push the request on the completion queue, and write the eventfd 
+    // unless it has been written since the last reap
+    async_queue_push(pool->async_cq, req);
+    if (__sync_lock_test_and_set(&pool->async_notify, 1) == 0) {
+        if (write(pool->async_fd, &v, sizeof(v)) < 0) {
+            // the eventfd counter can not overflow, it is cleared by each reap
+        }
+    }
+    return true;
+}
+
+// -----------------  GENERATOR  -----------------------------------
+
+// The generator makes minimal puzzles, which have a unique solution and from
+// which no clue can be removed without losing uniqueness. A puzzle is made by:
+// - filling a grid: a search of the empty board, which tries the values of 
+//   each branch location in random order, and stops at the first solution
+// - removing the clues, in random order: a clue is kept if the puzzle 
+//   without it does not have a unique solution; removing clues can only add
+//   solutions, so a clue that is kept is needed by the final puzzle too
+//
+// The puzzles are generated by the workers, which claim batch chunks of 
+// GENERATE_CHUNK_PUZZLES puzzle numbers; so each uniqueness check is run by
+// the worker, with its own board and engine, and there is no communication 
+// between the workers for the checks. The random state of a puzzle is seeded
+// from the seed and the puzzle number, so the puzzles generated are the same
+// for any number of threads. As with batch mode, a window of chunks is 
+// generated by each run, and the chunk results are given to the batch_cb in 
+// order: a line per puzzle, in the batch line format, or packed records.
+
+static inline uint64_t generate_random(uint64_t * state)
+{
+    uint64_t z;
+
+    // splitmix64
+    z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static bool generate_fill(worker_t * w, board_t * b, uint64_t * rng)
+{
+    uint32_t best_num_pv, best_locidx=-1, best_pv=-1;
+    uint32_t vals[MAX_VALUE], n, i, j, t;
+    board_t  child;
+    int32_t  rc;
+
+    // propagate, and if there is no solution, or the board is solved, then return
+    w->num_nodes++;
+    rc = propagate(w, b, &best_locidx, &best_pv, &best_num_pv);
+    if (rc <= 0) {
+        return rc == 0;
+    }
+
+    // try the possible values of the branch location in random order, 
+    // until one of them leads to a solution
+    for (n = 0; best_pv; best_pv &= best_pv - 1) {
+        vals[n++] = __builtin_ctz(best_pv);
+    }
+    for (i = n - 1; i > 0; i--) {
+        j = generate_random(rng) % (i + 1);
+        t = vals[i]; vals[i] = vals[j]; vals[j] = t;
+    }
+    for (i = 0; i < n; i++) {
+        child = *b;
+        board_set(&child, best_locidx, vals[i]);
+        if (generate_fill(w, &child, rng)) {
+            *b = child;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool generate_unique(worker_t * w, puzzle_t * p, uint64_t id)
+{
+    job_t   job;
+    board_t b;
+
+    // return true if the puzzle has a unique solution, the search stops
+    // at the second solution
+    memset(&job, 0, sizeof(job));
+    job.puzzle = *p;
+    job.max_solutions = 2;
+    job.id = id;
+    if (!board_init(&b, p)) {
+        return false;
+    }
+    w->num_tasks++;
+    w->job = &job;
+    run_task(w, &b);
+    w->job = NULL;
+    return job.num_solutions == 1;
+}
+
+static void generate_chunk(worker_t * w, chunk_t * c)
+{
+    sudoku_ctx_t * ctx = w->ctx;
+    loc_t    locs[MAX_LOC], t;
+    uint8_t  value;
+    uint64_t n, rng;
+    uint32_t i, j, locidx;
+    puzzle_t empty;
+    board_t  b;
+
+    // generate the chunk's puzzles, the results are written to the chunk's out buffer
+    c->out_len = c->num_puzzles = c->num_clues = 0;
+    c->error = NULL;
+    memset(empty.value, NO_VALUE, sizeof(empty.value));
+    empty.num_no_value = MAX_LOC;
+    for (n = c->first; n < c->first + c->count && !ctx->cancel; n++) {
+        // fill a grid; as the empty board has solutions this fails only 
+        // when cancelled
+        rng = w->pool->generate_seed ^ (n * 0xd1b54a32d192ed03ULL);
+        board_init(&b, &empty);
+        if (!generate_fill(w, &b, &rng)) {
+            break;
+        }
+
+        // remove the clues, in random order, keeping those that are needed
+        // for the solution to be unique
+        for (i = 0; i < MAX_LOC; i++) {
+            locs[i] = i;
+        }
+        for (i = MAX_LOC - 1; i > 0; i--) {
+            j = generate_random(&rng) % (i + 1);
+            t = locs[i]; locs[i] = locs[j]; locs[j] = t;
+        }
+        for (i = 0; i < MAX_LOC; i++) {
+            locidx = locs[i];
+            value = b.p.value[locidx];
+            b.p.value[locidx] = NO_VALUE;
+            b.p.num_no_value++;
+            if (!generate_unique(w, &b.p, n * MAX_LOC + i + 1)) {
+                b.p.value[locidx] = value;
+                b.p.num_no_value--;
+            }
+        }
+
+        // a cancelled uniqueness check may have kept too few clues, 
+        // so the puzzle is not output
+        if (ctx->cancel) {
+            break;
+        }
+
+        // write the puzzle
+        if (ctx->output_format == FORMAT_PACKED) {
+            sudoku_pack(&b.p, 0, (uint8_t*)c->out + c->out_len);
+            c->out_len += PACKED_SIZE;
+        } else {
+            for (locidx = 0; locidx < MAX_LOC; locidx++) {
+                c->out[c->out_len++] = (b.p.value[locidx] == NO_VALUE ? '.' : SUDOKU_VALUE_CHAR(b.p.value[locidx]));
+            }
+            c->out[c->out_len++] = '\n';
+        }
+
+        // stats
+        c->num_puzzles++;
+        c->num_clues += MAX_LOC - b.p.num_no_value;
+    }
+}
+
+int64_t sudoku_generate(sudoku_ctx_t * ctx, uint64_t num_puzzles, uint64_t seed)
+{
+    pool_t * pool = ctx->pool;
+    uint64_t num_generated = ctx->stats.num_puzzles;
+    uint64_t n;
+    uint32_t i;
+
+    // generate the puzzles, a window of chunks at a time
+    batch_chunks_alloc(ctx);
+#ifdef VERIFY_SOLUTIONS
+    verify_reset(ctx);
+#endif
+    pool->generate = true;
+    pool->generate_seed = seed;
+    for (n = 0; n < num_puzzles && !ctx->cancel; ) {
+        pool->max_batch_chunks = 0;
+        while (n < num_puzzles && pool->max_batch_chunks < BATCH_WINDOW_CHUNKS) {
+            chunk_t * c = &pool->batch_chunks[pool->max_batch_chunks++];
+            c->first = n;
+            c->count = (num_puzzles - n < GENERATE_CHUNK_PUZZLES ? num_puzzles - n : GENERATE_CHUNK_PUZZLES);
+            n += c->count;
+        }
+        pool->batch_next = 0;
+        pool_run(ctx, 0);
+
+        // give the results to the batch_cb, in order, and keep track of the stats
+        for (i = 0; i < pool->max_batch_chunks; i++) {
+            chunk_t * c = &pool->batch_chunks[i];
+            if (ctx->batch_cb) {
+                ctx->batch_cb(ctx, c->out, c->out_len);
+            }
+            ctx->stats.num_puzzles += c->num_puzzles;
+            ctx->stats.num_clues   += c->num_clues;
+        }
+    }
+    pool->generate = false;
+    stats_update(ctx);
+
+    return ctx->stats.num_puzzles - num_generated;
+}
+
+// -----------------  FORMAT PUZZLE  -----------------------------
+
+uint32_t sudoku_format_puzzle(sudoku_ctx_t * ctx, puzzle_t * p, uint64_t ts, char * s)
+{
+    uint32_t line, row=0, len=0, col, i;
+    uint64_t us, rate;
+    char str[100];
+
+    // format the puzzle, in the box format, and return the length; when
+    // ctx is not NULL the solution number, and the solutions rate since 
+    // the start of the run, are formatted to the right of the box; for
+    // 9x9 the lines are
+    //   +-------+-------+-------+
+    //   | 7   4 |       |       |
+    for (line = 0; line <= MAX_VALUE + BOX_SIZE; line++) {
+        if (line % (BOX_SIZE + 1) == 0) {
+            s[len++] = '+';
+            for (i = 0; i < BOX_SIZE; i++) {
+                memset(s+len, '-', 2 * BOX_SIZE + 1);
+                len += 2 * BOX_SIZE + 1;
+                s[len++] = '+';
+            }
+        } else {
+            uint8_t * v = &p->value[row*MAX_VALUE];
+            s[len++] = '|';
+            for (col = 0; col < MAX_VALUE; col++) {
+                s[len++] = ' ';
+                s[len++] = (v[col] == NO_VALUE ? ' ' : SUDOKU_VALUE_CHAR(v[col]));
+                if (col % BOX_SIZE == BOX_SIZE - 1) {
+                    s[len++] = ' ';
+                    s[len++] = '|';
+                }
+            }
+            row++;
+        }
+
+        if (ctx) {
+            if (line == 0) {
+                len += sprintf(s+len, " total_solutions     = %s", numeric_str(ts,str));
+            }
+            if (line == 1) {
+                len += sprintf(s+len, " num_threads         = %d", ctx->pool->num_threads);
+            }
+            if (line == 2 && ts > 1) {
+                us = microsec_timer();
+                rate = ts * 1000000L / (us - ctx->pool->start_us + 1);
+                len += sprintf(s+len, " solutions_rate      = %s / sec", numeric_str(rate,str));        
+            }
+        }
+
+        s[len++] = '\n';
+    }
+    s[len++] = '\n';
+    return len;
+}
+
+// -----------------  PACKED FORMAT  -------------------------------
+
+// A packed record is 41 bytes, 4 bits per location. Location n is in 
+// byte n/2, in the low 4 bits when n is even and the high 4 bits when n is
+// odd. The value is 1 to 9, or 0 for blank. The high 4 bits of the last 
+// byte are unused by the locations; in a solution record they are the number
+// of solutions found, 15 if 15 or more.
+//
+// For 16x16 and 25x25 a packed record is a byte per location, followed by a
+// byte which in a solution record is the number of solutions found, 255 if
+// 255 or more.
+//
+// A packed file is a sequence of records, with no header.
+
+void sudoku_pack(puzzle_t * p, uint32_t num_solutions, uint8_t * rec)
+{
+    uint32_t locidx;
+    uint8_t  v;
+
+    memset(rec, 0, PACKED_SIZE);
+    for (locidx = 0; locidx < MAX_LOC; locidx++) {
+        v = (p->value[locidx] == NO_VALUE ? 0 : p->value[locidx]);
+        if (MAX_VALUE <= 9) {
+            rec[locidx/2] |= (locidx & 1) ? (v << 4) : v;
+        } else {
+            rec[locidx] = v;
+        }
+    }
+    if (MAX_VALUE <= 9) {
+        rec[PACKED_SIZE-1] |= (num_solutions >= 15 ? 15 : num_solutions) << 4;
+    } else {
+        rec[PACKED_SIZE-1] = (num_solutions >= 255 ? 255 : num_solutions);
+    }
+}
+
+bool sudoku_unpack(uint8_t * rec, puzzle_t * p)
+{
+    uint32_t locidx;
+    uint8_t  v;
+
+    // unpack the record, return false if a location's value is invalid
+    p->num_no_value = MAX_LOC;
+    for (locidx = 0; locidx < MAX_LOC; locidx++) {
+        if (MAX_VALUE <= 9) {
+            v = (locidx & 1) ? (rec[locidx/2] >> 4) : (rec[locidx/2] & 0xf);
+        } else {
+            v = rec[locidx];
+        }
+        if (v > MAX_VALUE) {
+            return false;
+        }
+        if (v == 0) {
+            p->value[locidx] = NO_VALUE;
+        } else {
+            p->value[locidx] = v;
+            p->num_no_value--;
+        }
+    }
+    return true;
+}
+
+// -----------------  RESULT CACHE  --------------------------------
+
+#if BOX_SIZE == 3
+
+// When ctx->cache_memory is set, the results of the batch puzzles are cached,
+// keyed by the puzzle's canonical form; so a puzzle that is a repeat of an 
+// earlier one, or is equivalent to it by the sudoku symmetries, is not solved 
+// again. The symmetries are transposing, permuting the bands and the rows 
+// within each band, permuting the stacks and the columns within each stack, 
+// and relabeling the digits.
+//
+// The canonical form is the least, in row order with blank as 0, of the 
+// puzzle's transforms, with the digits relabeled in order of their first 
+// appearance. Rather than all 3,359,232 transforms, just those that order the
+// rows and columns by invariant keys are compared: 
+// - a row's key is its number of clues, and the number of its clues in 
+//   columns with each number of clues; a column's key is likewise
+// - the bands are ordered by their sorted row keys, and the rows within a
+//   band by their key; and the same for the stacks and columns
+// - rows, or bands, with equal keys are taken in each of their orders
+// The keys are unchanged by the symmetries, so equivalent puzzles have the
+// same set of transforms compared, and the same canonical form. A puzzle with
+// more than CANON_MAX_TRANSFORMS to compare, which has many equal keys, is 
+// not cached.
+//
+// A cache entry is the canonical puzzle, its number of solutions and its 
+// first solution. The solution found for a puzzle is mapped to the solution 
+// of the canonical puzzle, and a cached solution is mapped back by the 
+// inverse transform. The cache is sharded by the key's hash, each shard has 
+// its own mutex; a shard is a table of buckets of CACHE_WAYS entries each, 
+// the least recently used entry of the bucket is replaced. The cache's 
+// memory is allocated when the context is created.
+//
+// The canonical form is of 9x9 boards, with 3 bands and stacks; sudoku_create
+// fails when cache_memory is set for the other board sizes.
+
+typedef struct {
+    uint8_t  key[PACKED_SIZE];          // the canonical puzzle, packed
+    uint8_t  map[81];                   // canonical location i is the puzzle's location map[i], 
+    uint8_t  relabel[10];               //  with its value relabeled
+} canon_t;
+
+typedef struct {
+    uint64_t hash;                      // of the key, 0 for an unused entry
+    uint32_t stamp;                     // when the entry was last used
+    uint32_t num_solutions;
+    uint8_t  key[PACKED_SIZE];
+    uint8_t  solution[PACKED_SIZE];     // the first solution of the canonical puzzle, packed
+    uint8_t  pad[6];
+} cache_ent_t;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    cache_ent_t   * ent;                // num_buckets of CACHE_WAYS entries
+    uint64_t        num_buckets;
+    uint32_t        stamp;
+} __attribute__((aligned(64))) cache_shard_t;
+
+typedef struct cache {
+    cache_shard_t   shard[CACHE_SHARDS];
+} cache_t;
+
+static const uint8_t perms3[6][3] = { {0,1,2}, {0,2,1}, {1,0,2}, {1,2,0}, {2,0,1}, {2,1,0} };
+
+static inline int32_t canon_cmp3(uint64_t * a, uint64_t * b)
+{
+    uint32_t i;
+
+    for (i = 0; i < 3; i++) {
+        if (a[i] != b[i]) {
+            return (a[i] < b[i] ? -1 : 1);
+        }
+    }
+    return 0;
+}
+
+static uint32_t canon_orders(uint64_t key[9], uint8_t orders[][9])
+{
+    uint64_t bkey[3][3], t;
+    uint8_t  band_perm[6], row_perm[3][6], num_row_perm[3];
+    uint32_t num_band_perm, n, i, j, m, bp, c[3], band;
+    uint8_t  * p;
+
+    // sort the row keys of each band
+    for (band = 0; band < 3; band++) {
+        memcpy(bkey[band], &key[3*band], sizeof(bkey[band]));
+        for (i = 0; i < 2; i++) {
+            for (j = 0; j < 2 - i; j++) {
+                if (bkey[band][j] > bkey[band][j+1]) {
+                    t = bkey[band][j]; bkey[band][j] = bkey[band][j+1]; bkey[band][j+1] = t;
+                }
+            }
+        }
+    }
+
+    // the orders of the bands by their sorted row keys, and of the rows
+    // within each band by their keys
+    num_band_perm = 0;
+    for (i = 0; i < 6; i++) {
+        p = (uint8_t*)perms3[i];
+        if (canon_cmp3(bkey[p[0]], bkey[p[1]]) <= 0 && canon_cmp3(bkey[p[1]], bkey[p[2]]) <= 0) {
+            band_perm[num_band_perm++] = i;
+        }
+    }
+    for (band = 0; band < 3; band++) {
+        num_row_perm[band] = 0;
+        for (i = 0; i < 6; i++) {
+            p = (uint8_t*)perms3[i];
+            if (key[3*band+p[0]] <= key[3*band+p[1]] && key[3*band+p[1]] <= key[3*band+p[2]]) {
+                row_perm[band][num_row_perm[band]++] = i;
+            }
+        }
+    }
+
+    // return the orders of the rows, for each band order and each of the 
+    // row orders of the bands
+    n = 0;
+    for (bp = 0; bp < num_band_perm; bp++) {
+        for (c[0] = 0; c[0] < num_row_perm[0]; c[0]++) {
+            for (c[1] = 0; c[1] < num_row_perm[1]; c[1]++) {
+                for (c[2] = 0; c[2] < num_row_perm[2]; c[2]++) {
+                    for (j = 0; j < 3; j++) {
+                        band = perms3[band_perm[bp]][j];
+                        for (m = 0; m < 3; m++) {
+                            orders[n][3*j+m] = 3 * band + perms3[row_perm[band][c[band]]][m];
+                        }
+                    }
+                    n++;
+                }
+            }
+        }
+    }
+    return n;
+}
+
+static bool canon_form(puzzle_t * p, canon_t * cf)
+{
+    uint8_t  v[81], best[81], cand[81], lab[10], next;
+    uint8_t  row_orders[1296][9], col_orders[1296][9];
+    uint64_t row_key[9], col_key[9];
+    uint32_t row_cnt[9], col_cnt[9], t, r, c, i, nr, nc, ir, ic, total = 0;
+    uint8_t  * R, * C, x, y;
+    int32_t  cmp;
+    bool     found = false;
+
+    // for the puzzle, and its transpose
+    for (t = 0; t < 2; t++) {
+        // the values, with blank as 0, and the clue counts of the rows and columns
+        memset(row_cnt, 0, sizeof(row_cnt));
+        memset(col_cnt, 0, sizeof(col_cnt));
+        for (r = 0; r < 9; r++) {
+            for (c = 0; c < 9; c++) {
+                x = p->value[t ? c * 9 + r : r * 9 + c];
+                v[r*9+c] = (x == NO_VALUE ? 0 : x);
+                row_cnt[r] += (x != NO_VALUE);
+                col_cnt[c] += (x != NO_VALUE);
+            }
+        }
+
+        // the row and column keys, and the orders of the rows and columns
+        for (i = 0; i < 9; i++) {
+            row_key[i] = (uint64_t)row_cnt[i] << 40;
+            col_key[i] = (uint64_t)col_cnt[i] << 40;
+        }
+        for (r = 0; r < 9; r++) {
+            for (c = 0; c < 9; c++) {
+                if (v[r*9+c]) {
+                    row_key[r] += 1ULL << (4 * (col_cnt[c] - 1));
+                    col_key[c] += 1ULL << (4 * (row_cnt[r] - 1));
+                }
+            }
+        }
+        nr = canon_orders(row_key, row_orders);
+        nc = canon_orders(col_key, col_orders);
+        total += nr * nc;
+        if (total > CANON_MAX_TRANSFORMS) {
+            return false;
+        }
+
+        // compare the transforms, keeping the least
+        for (ir = 0; ir < nr; ir++) {
+            R = row_orders[ir];
+            for (ic = 0; ic < nc; ic++) {
+                C = col_orders[ic];
+                memset(lab, 0, sizeof(lab));
+                next = 1;
+                cmp = (found ? 0 : -1);
+                for (i = 0; i < 81; i++) {
+                    x = v[R[i/9]*9 + C[i%9]];
+                    y = (x == 0 ? 0 : lab[x] ? lab[x] : (lab[x] = next++));
+                    if (cmp == 0 && y != best[i]) {
+                        cmp = (y < best[i] ? -1 : 1);
+                        if (cmp > 0) {
+                            break;
+                        }
+                    }
+                    cand[i] = y;
+                }
+                if (cmp >= 0) {
+                    continue;
+                }
+
+                // this transform is the least so far; keep its map, and the
+                // relabeling, the digits not in the puzzle are relabeled in order
+                found = true;
+                memcpy(best, cand, sizeof(best));
+                for (i = 0; i < 81; i++) {
+                    cf->map[i] = (t ? C[i%9] * 9 + R[i/9] : R[i/9] * 9 + C[i%9]);
+                }
+                for (x = 1; x <= 9; x++) {
+                    if (lab[x] == 0) {
+                        lab[x] = next++;
+                    }
+                }
+                memcpy(cf->relabel, lab, sizeof(lab));
+            }
+        }
+    }
+
+    // pack the canonical puzzle, it is the key
+    memset(cf->key, 0, PACKED_SIZE);
+    for (i = 0; i < 81; i++) {
+        cf->key[i/2] |= (i & 1) ? (best[i] << 4) : best[i];
+    }
+    return true;
+}
+
+static void cache_create(sudoku_ctx_t * ctx)
+{
+    cache_t * cache;
+    uint64_t  num_buckets;
+    uint32_t  i;
+
+    // allocate the shards, and their entries, within the cache_memory
+    num_buckets = ctx->cache_memory / (CACHE_SHARDS * CACHE_WAYS * sizeof(cache_ent_t));
+    if (num_buckets == 0) {
+        num_buckets = 1;
+    }
+    cache = calloc(1, sizeof(cache_t));
+    if (cache == NULL) {
+        printf("ERROR: failed to allocate cache\n");
+        exit(1);
+    }
+    for (i = 0; i < CACHE_SHARDS; i++) {
+        pthread_mutex_init(&cache->shard[i].mutex, NULL);
+        cache->shard[i].num_buckets = num_buckets;
+        cache->shard[i].ent = calloc(num_buckets * CACHE_WAYS, sizeof(cache_ent_t));
+        if (cache->shard[i].ent == NULL) {
+            printf("ERROR: failed to allocate cache entries\n");
+            exit(1);
+        }
+    }
+    ctx->pool->cache = cache;
+}
+
+static void cache_destroy(sudoku_ctx_t * ctx)
+{
+    cache_t * cache = ctx->pool->cache;
+    uint32_t  i;
+
+    for (i = 0; i < CACHE_SHARDS; i++) {
+        pthread_mutex_destroy(&cache->shard[i].mutex);
+        free(cache->shard[i].ent);
+    }
+    free(cache);
+    ctx->pool->cache = NULL;
+}
+
+static inline uint64_t cache_hash(uint8_t * key)
+{
+    uint64_t h = 0, word[6] = { 0 };
+    uint32_t i;
+
+    memcpy(word, key, PACKED_SIZE);
+    for (i = 0; i < 6; i++) {
+        h = (h ^ word[i]) * 0x9e3779b97f4a7c15UL;
+        h ^= h >> 29;
+    }
+    return h | 1;
+}
+
+static bool cache_access(cache_t * cache, canon_t * cf, bool insert, uint8_t * solution, uint32_t * num_solutions)
+{
+    cache_shard_t * shard;
+    cache_ent_t   * ent, * lru;
+    uint64_t        h;
+    uint32_t        i;
+    bool            found = false;
+
+    // find the entry of the key in its bucket; if found and not inserting
+    // then return its solution; if inserting then the entry, or the bucket's
+    // least recently used entry, is set
+    h = cache_hash(cf->key);
+    shard = &cache->shard[h % CACHE_SHARDS];
+    ent = &shard->ent[(h / CACHE_SHARDS) % shard->num_buckets * CACHE_WAYS];
+    pthread_mutex_lock(&shard->mutex);
+    lru = &ent[0];
+    for (i = 0; i < CACHE_WAYS; i++) {
+        if (ent[i].hash == h && memcmp(ent[i].key, cf->key, PACKED_SIZE) == 0) {
+            found = true;
+            lru = &ent[i];
+            break;
+        }
+        if (ent[i].stamp < lru->stamp) {
+            lru = &ent[i];
+        }
+    }
+    if (found && !insert) {
+        memcpy(solution, lru->solution, PACKED_SIZE);
+        *num_solutions = lru->num_solutions;
+    } else if (insert) {
+        lru->hash = h;
+        memcpy(lru->key, cf->key, PACKED_SIZE);
+        memcpy(lru->solution, solution, PACKED_SIZE);
+        lru->num_solutions = *num_solutions;
+    }
+    if (found || insert) {
+        lru->stamp = ++shard->stamp;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    return found;
+}
+
+static void cache_find_solutions(worker_t * w, job_t * job, board_t * b)
+{
+    uint8_t  rec[PACKED_SIZE], inv[10];
+    uint32_t num_solutions, i;
+    puzzle_t cs;
+    canon_t  cf;
+
+    // if the puzzle's canonical form is cached then map its solution to
+    // the puzzle, by the inverse of the transform, and return
+    if (!canon_form(&job->puzzle, &cf)) {
+        w->cache_misses++;
+        w->num_tasks++;
+        run_task(w, b);
+        return;
+    }
+    if (cache_access(w->pool->cache, &cf, false, rec, &num_solutions)) {
+        w->cache_hits++;
+        job->num_solutions = num_solutions;
+        if (num_solutions > 0) {
+            sudoku_unpack(rec, &cs);
+            for (i = 1; i <= 9; i++) {
+                inv[cf.relabel[i]] = i;
+            }
+            for (i = 0; i < 81; i++) {
+                job->solution.value[cf.map[i]] = inv[cs.value[i]];
+            }
+            job->solution.num_no_value = 0;
+        }
+        return;
+    }
+
+    // find the solutions, and cache them, with the solution mapped to 
+    // the canonical puzzle's
+    w->cache_misses++;
+    w->num_tasks++;
+    run_task(w, b);
+    memset(&cs, 0, sizeof(cs));
+    if (job->num_solutions > 0) {
+        for (i = 0; i < 81; i++) {
+            cs.value[i] = cf.relabel[job->solution.value[cf.map[i]]];
+        }
+    }
+    sudoku_pack(&cs, 0, rec);
+    num_solutions = job->num_solutions;
+    cache_access(w->pool->cache, &cf, true, rec, &num_solutions);
+}
+#endif
+
+// -----------------  VERIFY SLUTION  ------------------------------
+
+#ifdef VERIFY_SOLUTIONS
+
+// The solutions found are kept in a hash set, so that a duplicate solution
+// is detected in about constant time. The key of a solution is its packed
+// record and the job's id, which identifies the puzzle of a batch job. The
+// set is sharded by the key's hash; a shard is an open addressing table, 
+// with its own mutex, which is doubled in size when half full. When the 
+// shards have used VERIFY_MAX_MEMORY the solutions are still checked, and 
+// duplicates of those in the set are still detected, but no more are added.
+// The set is reset at the start of each solve.
+
+// the packed solution is followed by the job id, in the last word of the key
+#define VERIFY_KEY_WORDS  ((PACKED_SIZE + 7) / 8)
+#define VERIFY_ID_SHIFT   (8 * (PACKED_SIZE % 8))
+
+typedef struct {
+    uint64_t word[VERIFY_KEY_WORDS];    // packed solution, and the job id; all 0 is an empty slot
+} verify_key_t;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    verify_key_t  * tbl;
+    uint64_t        size;               // number of slots, a power of 2
+    uint64_t        count;              // number of slots used
+} __attribute__((aligned(64))) verify_shard_t;
+
+typedef struct verify_set {
+    verify_shard_t  shard[VERIFY_SHARDS];
+    uint64_t        memory;             // memory used by the shard tables
+    bool            full;               // the memory budget has been reached
+} verify_set_t;
+
+static void verify_create(sudoku_ctx_t * ctx)
+{
+    verify_set_t * vs;
+    uint32_t i;
+
+    vs = calloc(1, sizeof(verify_set_t));
+    if (vs == NULL) {
+        printf("ERROR: failed to allocate verify set\n");
+        exit(1);
+    }
+    for (i = 0; i < VERIFY_SHARDS; i++) {
+        pthread_mutex_init(&vs->shard[i].mutex, NULL);
+    }
+    ctx->pool->verify = vs;
+}
+
+static void verify_reset(sudoku_ctx_t * ctx)
+{
+    verify_set_t * vs = ctx->pool->verify;
+    uint32_t i;
+
+    // free the shard tables, this is called when the workers are not running
+    for (i = 0; i < VERIFY_SHARDS; i++) {
+        free(vs->shard[i].tbl);
+        vs->shard[i].tbl = NULL;
+        vs->shard[i].size = vs->shard[i].count = 0;
+    }
+    vs->memory = 0;
+    vs->full = false;
+}
+
+static void verify_destroy(sudoku_ctx_t * ctx)
+{
+    verify_set_t * vs = ctx->pool->verify;
+    uint32_t i;
+
+    verify_reset(ctx);
+    for (i = 0; i < VERIFY_SHARDS; i++) {
+        pthread_mutex_destroy(&vs->shard[i].mutex);
+    }
+    free(vs);
+    ctx->pool->verify = NULL;
+}
+
+static inline uint64_t verify_hash(verify_key_t * key)
+{
+    uint64_t h = 0;
+    uint32_t i;
+
+    for (i = 0; i < VERIFY_KEY_WORDS; i++) {
+        h = (h ^ key->word[i]) * 0x9e3779b97f4a7c15UL;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+static bool verify_insert(verify_set_t * vs, verify_key_t * key)
+{
+    verify_shard_t * shard;
+    verify_key_t   * tbl, * slot;
+    uint64_t         h, i, j, size, new_size;
+    bool             inserted = false;
+
+    // find the key in its shard, and if not found then add it; return 
+    // false if the key is already in the set
+    h = verify_hash(key);
+    shard = &vs->shard[h % VERIFY_SHARDS];
+    h /= VERIFY_SHARDS;
+    pthread_mutex_lock(&shard->mutex);
+
+    // if the shard is half full, or empty, then double its size; the 
+    // keys are rehashed to the new table
+    if (shard->count >= shard->size / 2 && !vs->full) {
+        new_size = (shard->size == 0 ? 1024 : 2 * shard->size);
+        if (__sync_add_and_fetch(&vs->memory, new_size * sizeof(verify_key_t)) > VERIFY_MAX_MEMORY) {
+            __sync_sub_and_fetch(&vs->memory, new_size * sizeof(verify_key_t));
+            if (!vs->full) {
+                printf("WARNING: verify memory budget used, solutions found are no longer added\n");
+                vs->full = true;
+            }
+        } else {
+            tbl = calloc(new_size, sizeof(verify_key_t));
+            if (tbl == NULL) {
+                printf("ERROR: failed to allocate verify table\n");
+                exit(1);
+            }
+            for (i = 0; i < shard->size; i++) {
+                if (shard->tbl[i].word[VERIFY_KEY_WORDS-1] == 0) {
+                    continue;
+                }
+                for (j = verify_hash(&shard->tbl[i]) / VERIFY_SHARDS; tbl[j & (new_size-1)].word[VERIFY_KEY_WORDS-1]; j++) ;
+                tbl[j & (new_size-1)] = shard->tbl[i];
+            }
+            free(shard->tbl);
+            __sync_sub_and_fetch(&vs->memory, shard->size * sizeof(verify_key_t));
+            shard->tbl = tbl;
+            shard->size = new_size;
+        }
+    }
+
+    // probe for the key, and add it in the first empty slot when there is room
+    size = shard->size;
+    for (i = 0; i < size; i++) {
+        slot = &shard->tbl[(h + i) & (size-1)];
+        if (slot->word[VERIFY_KEY_WORDS-1] == 0) {
+            if (shard->count < size - 1) {
+                *slot = *key;
+                shard->count++;
+            }
+            inserted = true;
+            break;
+        }
+        if (memcmp(slot, key, sizeof(verify_key_t)) == 0) {
+            break;
+        }
+    }
+    if (i == size) {
+        inserted = true;
+    }
+
+    pthread_mutex_unlock(&shard->mutex);
+    return inserted;
+}
+
+static void verify_solution(worker_t * w, puzzle_t * p) 
+{
+    static const char * unit_names[] = { "row", "col", "grid" };
+    uint32_t unit, i;
+    mask_t   v;
+    verify_key_t key;
+
+    // if the solution is incorrect (indicates a program bug) then
+    // - print error message
+    // - exit this prgram
+
+    // verify solution is correct, by checking for presence of 1..MAX_VALUE 
+    // in each row, column and grid
+    for (unit = 0; unit < MAX_UNIT; unit++) {
+        for (v = 0, i = 0; i < MAX_VALUE; i++) {
+            v |= (mask_t)1 << p->value[unit_locs[unit][i]];
+        }
+        if (v != ALL_VALUES) {
+            printf("ERROR: invalid soution - %s %d\n", unit_names[unit / MAX_VALUE], unit % MAX_VALUE);
+            exit(1);
+        }
+    }
+
+    // check if this solution has already been found, and remember it so
+    // it can be compared with future solutions; the last byte of the packed
+    // solution, which has the number of solutions, is not 0, so the key of a
+    // solution is not all 0
+    memset(&key, 0, sizeof(key));
+    sudoku_pack(p, 1, (uint8_t*)key.word);
+    key.word[VERIFY_KEY_WORDS-1] |= w->job->id << VERIFY_ID_SHIFT;
+    if (!verify_insert(w->pool->verify, &key)) {
+        printf("ERROR: this solution is a duplicate, exitting\n");
+        exit(1);
+    }
+}
+#endif
+
+// -----------------  UTILS - TIME  --------------------------------
+
+static uint64_t microsec_timer(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return  ((uint64_t)ts.tv_sec * 1000000) + ((uint64_t)ts.tv_nsec / 1000);
+}
+
+static uint64_t nanosec_timer(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return  ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+// -----------------  UTILS - NUMBER TO STRING  --------------------
+
+static char * numeric_str(uint64_t v, char * s)
+{
+    if (v < 1000L) {
+        sprintf(s, "%lu", v);
+    } else if (v < 1000000L) {
+        sprintf(s, "%.3f thousand", (double)v/1000);
+    } else if (v < 1000000000L) {
+        sprintf(s, "%.3f million", (double)v/1000000);
+    } else {
+        sprintf(s, "%.3f billion", (double)v/1000000000);
+    }
+    return s;
+}
+
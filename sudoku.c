@@ -20,386 +20,1404 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+// sudoku - command line interface to the solver library, libsudoku
+
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
-#include <pthread.h>
 #include <signal.h>
-#include <assert.h>
-
-//
-// defines
-//
-
-// #define VERIFY_SOLUTIONS
-
-#define NO_VALUE 255
-
-#define MAX_SOLUTIONS_INFINITE 0
-
-#define DEFAULT_MAX_THREADS    4
-#define DEFAULT_PRINT_INTERVAL 1000000
-#define DEFAULT_MAX_SOLUTIONS  MAX_SOLUTIONS_INFINITE
+#include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <endian.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
 
-#define ROW(locidx) (locidx / 9)
-#define COL(locidx) (locidx % 9)
-#define GRID_NUM(locidx) (ROW(locidx) / 3 * 3 + COL(locidx) / 3)
+#include "sudoku.h"
 
 //
-// typedefs
+// defines
 //
 
-typedef struct {
-    uint8_t value[81];
-    uint8_t pad[3];
-    uint32_t num_no_value;
-} puzzle_t;
+#define BATCH_WINDOW_SIZE      (16 * 1024 * 1024)       // batch input is solved a window at a time
+#define ASYNC_REAP             256                      // async batch, requests reaped at a time
+
+#define DIST_DEFAULT_DEPTH     6        // distributed count, the search is expanded to this depth,
+#define DIST_SHARD_STATES      64       //  and the branch states are sent to the workers in shards
+#define DIST_WORKER_SHARDS     2        // shards assigned to a worker at a time
+#define DIST_MAX_WORKERS       1024
+#define DIST_IO_TIMEOUT        30       // secs, a coordinator send or receive fails after this, and
+                                        //  a worker is lost when no message is received for this
+#define DIST_HEARTBEAT_INTERVAL 5       // secs, a worker sends a heartbeat at this interval
+#define DIST_MAGIC             0x444b4453
+#define DIST_MSG_HELLO         1
+#define DIST_MSG_SHARD         2
+#define DIST_MSG_RESULT        3
+#define DIST_MSG_DONE          4
+#define DIST_MSG_HEARTBEAT     5
+#define DIST_SHARD_PENDING     -1
+#define DIST_SHARD_COUNTED     -2
+
+#define MAX_ENGINE             3
+#define MAX_HEURISTIC          SUDOKU_MAX_HEURISTIC
+#define MAX_KERNEL             3
+#define MAX_ORDER              2
 
 //
 // variables
 //
 
-uint32_t max_threads    = DEFAULT_MAX_THREADS;      // params
-uint32_t print_interval = DEFAULT_PRINT_INTERVAL;
-uint64_t max_solutions  = DEFAULT_MAX_SOLUTIONS;
-
-uint32_t siblings[81][20];                          // siblings to a location
-uint8_t  pv2val[513];                               // convert possible value bitmask to value
-
-uint64_t total_solutions;                           // stats
-uint32_t num_threads;
-uint64_t num_thread_creates; 
-uint64_t find_solutions_start_us;
-uint64_t find_solutions_end_us;
-
-bool     find_solutions_done;                        // set true when find_solutions threads all done
+sudoku_ctx_t ctx;                                   // the solver context
+bool         batch_mode;
+bool         async_mode;                            // batch mode, using the async api
+bool         count_only;
+bool         resume;
+bool         unique;
+bool         symmetric;                             // count using the symmetries,
+bool         symmetric_check;                       //  and cross check with the plain count
+uint64_t     generate;                              // number of puzzles to generate
+uint64_t     generate_seed;
+uint32_t     dist_port;                             // distributed count coordinator, its port,
+uint32_t     dist_depth = DIST_DEFAULT_DEPTH;       //  and the depth the search is expanded to
+bool         dist_worker;                           // distributed count worker
+FILE       * info_fp;                               // where everything but the solutions is printed
 
 //
 // progotypes
 //
 
-void initialize(void);
-void find_solutions(puzzle_t p, bool new_thread);
-void possible_values(puzzle_t * p, uint32_t locidx, uint32_t * pv, uint32_t * num_pv);
-void * find_solutions_thread(void * cx);
-void read_puzzle(puzzle_t * p, char * filename);
-void print_puzzle(puzzle_t * p, bool print_stats, uint64_t ts);
-void verify_solution(puzzle_t * p);
+void batch_solve(char * filename);
+void async_batch_solve(char * filename);
+void distrib_coordinator(char * filename);
+void distrib_worker(char * hostport);
+void generate_puzzles(char * filename);
+void read_puzzle(sudoku_puzzle_t * p, char * filename);
+void print_puzzle(sudoku_puzzle_t * p);
 uint64_t microsec_timer(void);
 void sigint_register(void);
-bool sigint_check(void);
-void sigint_clear(void);
 char * numeric_str(uint64_t v, char * s);
+void usage(void);
+
+//
+// names
+//
+
+char * engine_names[MAX_ENGINE] = { "mrv", "dlx", "iter" };
+char * heuristic_names[MAX_HEURISTIC] = { "mrv", "degree", "lcv", "restart" };
+char * kernel_names[MAX_KERNEL] = { "auto", "scalar", "avx2" };
+char * order_names[MAX_ORDER] = { "any", "seq" };
 
 // -----------------  MAIN  ----------------------------------------
 
 int main(int argc, char ** argv)
 {
-    puzzle_t puzzle;
+    sudoku_puzzle_t puzzle, solution;
+    sudoku_stats_t * st = &ctx.stats;
     char *filename, s[100];
-    uint64_t rate;
+    uint64_t rate, total_solutions=0;
+    uint32_t i;
+    int32_t opt;
 
     // use line bufferring for stdout
     setlinebuf(stdout);
 
+    // init the solver config to the defaults
+    sudoku_defaults(&ctx);
+
+    // get options
+    while ((opt = getopt(argc, argv, "aAbB:cC:d:D:e:g:H:i:I:k:m:M:o:O:Rs:S:TuWx:yY")) != -1) {
+        switch (opt) {
+        case 'i': case 'o':
+            if (strcmp(optarg, "text") != 0 && strcmp(optarg, "packed") != 0) {
+                usage();
+                return 1;
+            }
+            *(opt == 'i' ? &ctx.input_format : &ctx.output_format) = 
+                (strcmp(optarg, "packed") == 0 ? SUDOKU_FORMAT_PACKED : SUDOKU_FORMAT_TEXT);
+            break;
+        case 'A':
+            ctx.affinity = true;
+            break;
+        case 'a':
+            batch_mode = async_mode = true;
+            break;
+        case 'D':
+            if (sscanf(optarg, "%d", &dist_port) != 1 || dist_port == 0 || dist_port > 65535) {
+                usage();
+                return 1;
+            }
+            count_only = true;
+            break;
+        case 'x':
+            if (sscanf(optarg, "%d", &dist_depth) != 1) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'W':
+            dist_worker = true;
+            break;
+        case 'b':
+            batch_mode = true;
+            break;
+        case 'c':
+            count_only = true;
+            break;
+        case 'C':
+            ctx.checkpoint_file = optarg;
+            break;
+        case 'I':
+            if (sscanf(optarg, "%d", &ctx.checkpoint_interval) != 1 || ctx.checkpoint_interval == 0) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'R':
+            resume = true;
+            break;
+        case 'd':
+            if (sscanf(optarg, "%d", &ctx.split_depth) != 1 || ctx.split_depth == 0) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'e':
+            for (ctx.engine = 0; ctx.engine < MAX_ENGINE; ctx.engine++) {
+                if (strcmp(optarg, engine_names[ctx.engine]) == 0) {
+                    break;
+                }
+            }
+            if (ctx.engine == MAX_ENGINE) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'B':
+            for (ctx.heuristic = 0; ctx.heuristic < MAX_HEURISTIC; ctx.heuristic++) {
+                if (strcmp(optarg, heuristic_names[ctx.heuristic]) == 0) {
+                    break;
+                }
+            }
+            if (ctx.heuristic == MAX_HEURISTIC) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'k':
+            for (ctx.kernel = 0; ctx.kernel < MAX_KERNEL; ctx.kernel++) {
+                if (strcmp(optarg, kernel_names[ctx.kernel]) == 0) {
+                    break;
+                }
+            }
+            if (ctx.kernel == MAX_KERNEL) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'O':
+            for (ctx.output_order = 0; ctx.output_order < MAX_ORDER; ctx.output_order++) {
+                if (strcmp(optarg, order_names[ctx.output_order]) == 0) {
+                    break;
+                }
+            }
+            if (ctx.output_order == MAX_ORDER) {
+                usage();
+                return 1;
+            }
+            break;
+        case 's':
+            ctx.strategies = optarg;
+            break;
+        case 'm':
+            ctx.metrics_fd = (strcmp(optarg, "-") == 0 
+                              ? STDERR_FILENO 
+                              : open(optarg, O_WRONLY|O_CREAT|O_TRUNC, 0644));
+            if (ctx.metrics_fd < 0) {
+                fprintf(stderr, "ERROR: failed to open %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'M':
+            if (sscanf(optarg, "%d", &ctx.metrics_interval_ms) != 1) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'T':
+            ctx.strategy_timing = true;
+            break;
+        case 'u':
+            unique = true;
+            break;
+        case 'y': case 'Y':
+            count_only = true;
+            symmetric = true;
+            symmetric_check = (opt == 'Y');
+            break;
+        case 'g':
+            if (sscanf(optarg, "%ld", &generate) != 1 || generate == 0) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'S':
+            if (sscanf(optarg, "%ld", &generate_seed) != 1) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'H':
+            if (sscanf(optarg, "%ld", &ctx.cache_memory) != 1 || ctx.cache_memory == 0) {
+                usage();
+                return 1;
+            }
+            ctx.cache_memory <<= 20;
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+
     // get args      
     if (argc < 2 || argc > 5 ||
-        (argc >= 3 && sscanf(argv[2], "%d", &max_threads) != 1) ||
-        (argc >= 4 && sscanf(argv[3], "%d", &print_interval) != 1) ||
-        (argc >= 5 && sscanf(argv[4], "%ld", &max_solutions) != 1))
+        (argc >= 3 && sscanf(argv[2], "%d", &ctx.max_threads) != 1) ||
+        (argc >= 4 && sscanf(argv[3], "%d", &ctx.print_interval) != 1) ||
+        (argc >= 5 && sscanf(argv[4], "%ld", &ctx.max_solutions) != 1) ||
+        (count_only && batch_mode) || (resume && batch_mode) ||
+        (async_mode && ctx.input_format == SUDOKU_FORMAT_PACKED) ||
+        (dist_port && (symmetric || argc >= 5)) ||
+        (dist_worker && (dist_port || batch_mode || count_only || resume || unique || generate ||
+                         ctx.checkpoint_file)) ||
+        (ctx.checkpoint_file && batch_mode) || (ctx.cache_memory && !batch_mode) ||
+        (unique && (batch_mode || count_only || resume)) ||
+        (symmetric && (resume || ctx.checkpoint_file || argc >= 5)) ||
+        (generate && (batch_mode || count_only || resume || unique || ctx.checkpoint_file)))
     {
-        printf("usage: sudoku <filename> [<max_thread>] [<print_intvl>] [<max_solutions>]\n");
-        return 0;
+        usage();
+        return 1;
     }
     filename = argv[1];
 
+    // when resuming, the filename is the checkpoint file, and the solve 
+    // continues to be checkpointed to it
+    if (resume) {
+        ctx.checkpoint_file = filename;
+    }
+
+    // the default seed of the generator is the time, it is printed so
+    // that the puzzles can be generated again
+    if (generate && generate_seed == 0) {
+        generate_seed = time(NULL);
+    }
+
+    // in batch mode, or when the output format is packed, the solutions are 
+    // written to stdout, fully buffered, and everything else is written to 
+    // stderr; also in batch mode by default just the first solution of each 
+    // puzzle is found
+    info_fp = stdout;
+    if (batch_mode || generate || ctx.output_format == SUDOKU_FORMAT_PACKED) {
+        setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+        info_fp = stderr;
+    }
+    if (batch_mode && argc < 5) {
+        ctx.max_solutions = 1;
+    }
+
+    // create the solver context, and its pool of worker threads
+    if (sudoku_create(&ctx) < 0) {
+        fprintf(stderr, "ERROR: %s\n", ctx.error);
+        usage();
+        return 1;
+    }
+
     // print args
-    printf("\n");
-    printf("filename       = %s\n", filename);
-    printf("max_threads    = %d\n", max_threads);
-    printf("print_interval = %d\n", print_interval);
-    printf("max_solutions  = %s\n",
-           (max_solutions == MAX_SOLUTIONS_INFINITE 
-            ? "infinite" : (sprintf(s, "%ld", max_solutions),s)));
-    printf("\n");
-
-#if 0
-    // prompt to continue
-    char ans[2];
-    printf("<cr> to continue: ");
-    fgets(ans, sizeof(ans), stdin);
-    printf("\n");
-    if (ans[0] != '\n') {
-        return 0;
-    }
-#endif
-
-    // register for SIGINT
+    fprintf(info_fp, "\n");
+    fprintf(info_fp, "filename       = %s%s%s\n", filename, 
+            async_mode ? " (batch, async)" : batch_mode ? " (batch)" : symmetric ? " (symmetric count)" : 
+            dist_port ? " (distributed)" : dist_worker ? " (distributed worker)" :
+            count_only ? " (count only)" : unique ? " (unique)" : 
+            generate ? " (generate)" : "",
+            resume ? " (resume)" : "");
+    fprintf(info_fp, "max_threads    = %d\n", ctx.max_threads);
+    if (dist_port) {
+        fprintf(info_fp, "port           = %d\n", dist_port);
+        fprintf(info_fp, "depth          = %d\n", dist_depth);
+    }
+    if (!batch_mode && !count_only && !unique && !dist_worker) {
+        fprintf(info_fp, "print_interval = %d\n", ctx.print_interval);
+        fprintf(info_fp, "output_order   = %s\n", order_names[ctx.output_order]);
+    }
+    if (generate) {
+        fprintf(info_fp, "generate       = %ld puzzles\n", generate);
+        fprintf(info_fp, "seed           = %ld\n", generate_seed);
+    } else if (!unique && !dist_port && !dist_worker) {
+        fprintf(info_fp, "max_solutions  = %s\n",
+               (ctx.max_solutions == SUDOKU_MAX_SOLUTIONS_INFINITE 
+                ? "infinite" : (sprintf(s, "%ld", ctx.max_solutions),s)));
+    }
+    if (ctx.cache_memory) {
+        fprintf(info_fp, "cache          = %ld MB\n", ctx.cache_memory >> 20);
+    }
+    if (ctx.checkpoint_file) {
+        fprintf(info_fp, "checkpoint     = %s, every %d secs\n", ctx.checkpoint_file, ctx.checkpoint_interval);
+    }
+    if (ctx.affinity) {
+        fprintf(info_fp, "affinity       = pinned\n");
+    }
+    fprintf(info_fp, "engine         = %s\n", engine_names[ctx.engine]);
+    fprintf(info_fp, "split_depth    = %d\n", ctx.split_depth);
+    if (ctx.engine != SUDOKU_ENGINE_DLX) {
+        fprintf(info_fp, "heuristic      = %s\n", heuristic_names[ctx.heuristic]);
+        fprintf(info_fp, "strategies     = %s\n", ctx.strategies);
+        fprintf(info_fp, "kernel         = %s\n", kernel_names[ctx.kernel]);
+    }
+    fprintf(info_fp, "\n");
+
+    // register for SIGINT, which cancels the solve
     sigint_register();
 
-    // initialize
-    initialize();
+    if (batch_mode) {
+        // solve the batch of puzzles
+        batch_solve(filename);
+    } else if (generate) {
+        // generate the puzzles
+        generate_puzzles(filename);
+    } else if (dist_port) {
+        // count the puzzle using the distributed workers
+        distrib_coordinator(filename);
+    } else if (dist_worker) {
+        // count the shards of the distributed coordinator at the filename, host:port
+        distrib_worker(filename);
+    } else if (resume) {
+        // resume the solve from the checkpoint, solutions found before the 
+        // checkpoint are not printed again
+        fprintf(info_fp, "Resuming ...\n");
+        fprintf(info_fp, count_only ? "Counting ...\n" : "Solutions ...\n");
+        fflush(stdout);
+        if (!count_only) {
+            ctx.output_fd = STDOUT_FILENO;
+        }
+        if (sudoku_resume(&ctx, count_only, &puzzle, NULL) < 0) {
+            fprintf(stderr, "ERROR: %s\n", ctx.error);
+            exit(1);
+        }
+    } else if (unique) {
+        // read the puzzle, and determine whether it has no solution, 
+        // a unique solution, or multiple solutions
+        read_puzzle(&puzzle, filename);
+        i = sudoku_unique(&ctx, &puzzle, &solution);
+        fprintf(info_fp, "result = %s\n\n", 
+                i == SUDOKU_UNIQUE_NONE ? "no solution" : i == SUDOKU_UNIQUE_ONE ? "unique" : "multiple");
+        if (i == SUDOKU_UNIQUE_ONE) {
+            print_puzzle(&solution);
+        }
+    } else {
+        // read the puzzle, and print
+        fprintf(info_fp, "Solving ...\n");
+        read_puzzle(&puzzle, filename);
+
+        // find solutions, they are written to stdout by the solver; in count
+        // only mode the solutions are counted, and not printed
+        fprintf(info_fp, count_only ? "Counting ...\n" : "Solutions ...\n");
+        fflush(stdout);
+        if (symmetric) {
+            int64_t n = sudoku_count_symmetric(&ctx, &puzzle);
+            if (n < 0) {
+                fprintf(stderr, "ERROR: %s\n", ctx.error);
+                exit(1);
+            }
+            fprintf(info_fp, "symmetry_factor    = %ld\n", st->symmetry_factor);
+            fprintf(info_fp, "symmetry_states    = %ld\n", st->symmetry_states);
+            fprintf(info_fp, "symmetric_count    = %ld\n", n);
+            if (symmetric_check) {
+                // the stats add up over the solves of the context, they are
+                // restored so the stats printed are the symmetric count's
+                sudoku_stats_t saved = *st;
+                int64_t plain = sudoku_count(&ctx, &puzzle);
+                *st = saved;
+                fprintf(info_fp, "plain_count        = %ld\n", plain);
+                if (plain != n && !ctx.cancel) {
+                    fprintf(stderr, "ERROR: symmetric count %ld, plain count %ld\n", n, plain);
+                    exit(1);
+                }
+            }
+        } else {
+            // the solve fails when its checkpoint can not be written
+            if (!count_only) {
+                ctx.output_fd = STDOUT_FILENO;
+            }
+            if ((count_only ? sudoku_count(&ctx, &puzzle) : sudoku_solve_one(&ctx, &puzzle, NULL)) < 0) {
+                fprintf(stderr, "ERROR: %s\n", ctx.error);
+                exit(1);
+            }
+        }
+    }
+    total_solutions = st->total_solutions;
 
-    // read the puzzle, and print
-    printf("Solving ...\n");
-    read_puzzle(&puzzle, filename);
+    // terminate the worker threads
+    sudoku_destroy(&ctx);
+    fflush(stdout);
 
-    // find solutions
-    printf("Solutions ...\n");
-    find_solutions(puzzle, false);
-    while (!find_solutions_done) {
-        usleep(1000);
+    // if terminated due to ctrl c then print message
+    if (ctx.cancel) {
+        fprintf(info_fp, "\n*** INTERRUPTED ***\n\n");
     }
 
-    // if terminated due to ctrl c then print message
-    if (sigint_check()) {
-        printf("\n*** INTERRUPTED ***\n\n");
+    // print the checkpoint stats, the branch states of the last checkpoint 
+    // are those still to be searched
+    if (ctx.checkpoint_file) {
+        fprintf(info_fp, "num_checkpoints    = %ld\n", st->num_checkpoints);
+        fprintf(info_fp, "checkpoint_states  = %ld%s\n", st->checkpoint_states,
+                st->checkpoint_states ? ", resume with -R" : " (complete)");
     }
 
     // print 
     // - total number of solutions found
     // - number of threads created 
+    // - number of branch states run as tasks, and how many were stolen
     // - rate that the solutions were found
-    rate = total_solutions * 1000000L / (find_solutions_end_us - find_solutions_start_us);
-    printf("total_solutions    = %s\n", numeric_str(total_solutions,s));
-    printf("num_thread_creates = %ld\n", num_thread_creates);
-    printf("solution_rate      = %s / sec\n", numeric_str(rate,s));
-    printf("\n");
+    rate = total_solutions * 1000000L / (st->duration_us + 1);
+    fprintf(info_fp, "total_solutions    = %s\n", numeric_str(total_solutions,s));
+    fprintf(info_fp, "num_thread_creates = %ld\n", st->num_thread_creates);
+    fprintf(info_fp, "num_tasks          = %s\n", numeric_str(st->num_tasks,s));
+    fprintf(info_fp, "num_steals         = %s\n", numeric_str(st->num_steals,s));
+    if (ctx.affinity) {
+        fprintf(info_fp, "num_remote_steals  = %s\n", numeric_str(st->num_remote_steals,s));
+    }
+    fprintf(info_fp, "num_nodes          = %s\n", numeric_str(st->num_nodes,s));
+    if (ctx.heuristic == SUDOKU_HEURISTIC_RESTART && ctx.engine != SUDOKU_ENGINE_DLX) {
+        fprintf(info_fp, "num_restarts       = %s\n", numeric_str(st->num_restarts,s));
+    }
+    if (!batch_mode && !generate) {
+        fprintf(info_fp, "solution_rate      = %s / sec\n", numeric_str(rate,s));
+    }
+    fprintf(info_fp, "\n");
+
+    // print the task size histogram, the number of tasks by the number of
+    // nodes they examined
+    fprintf(info_fp, "task_size (nodes)        num_tasks\n");
+    for (i = 0; i < SUDOKU_MAX_TASK_SIZE_HIST; i++) {
+        if (st->task_size_hist[i] == 0) {
+            continue;
+        }
+        if (i == 0) {
+            sprintf(s, "0 - 1");
+        } else if (i == SUDOKU_MAX_TASK_SIZE_HIST - 1) {
+            sprintf(s, ">= %ld", 1L << i);
+        } else {
+            sprintf(s, "%ld - %ld", 1L << i, (2L << i) - 1);
+        }
+        fprintf(info_fp, "%-20s %12ld\n", s, st->task_size_hist[i]);
+    }
+    fprintf(info_fp, "max_task_size      = %s\n", numeric_str(st->max_task_size,s));
+    fprintf(info_fp, "\n");
+
+    // print the stats for the strategies in the propagation pipeline
+    if (ctx.engine != SUDOKU_ENGINE_DLX) {
+        fprintf(info_fp, "strategy        calls      changes   contradictions         us\n");
+        for (i = 0; i < ctx.max_pipeline; i++) {
+            sudoku_strategy_stats_t * ss = &st->strategy_stats[ctx.pipeline[i]];
+            fprintf(info_fp, "%-8s %12ld %12ld %16ld %10ld\n",
+                   sudoku_strategy_name(ctx.pipeline[i]),
+                   ss->calls, ss->changes, ss->contradictions, ss->ns / 1000);
+        }
+        fprintf(info_fp, "\n");
+    }
 
     // terminate
     return 0;
 }
 
-void initialize(void)
+void usage(void)
 {
-    uint32_t locidx, li, max_sib;
-    uint8_t value;
-   
-    // init siblings 
-    for (locidx = 0; locidx < 81; locidx++) {
-        for (max_sib = 0, li = 0; li < 81; li++) {
-            if (li == locidx) {
-                continue;
+    fprintf(stderr, "usage: sudoku [-b|-a] [-H <mb>] [-c] [-y|-Y] [-u] [-g <num>] [-S <seed>] [-d <depth>] [-e <engine>] [-B <heuristic>]\n");
+    fprintf(stderr, "              [-i <format>] [-o <format>] [-O <order>] [-s <strategies>] [-k <kernel>] [-m <file>] [-M <ms>] [-T]\n");
+    fprintf(stderr, "              [-C <file>] [-I <secs>] [-R] [-A] [-D <port> [-x <depth>] | -W]\n");
+    fprintf(stderr, "              <filename> [<max_thread>] [<print_intvl>] [<max_solutions>]\n");
+    fprintf(stderr, "  -b             : batch mode, filename (or - for stdin) contains one puzzle\n");
+    fprintf(stderr, "                   per line, 81 chars with '.' or '0' for blank locations\n");
+    fprintf(stderr, "                   (256 or 625 for sudoku16 and sudoku25, see the README);\n");
+    fprintf(stderr, "                   the first solution of each puzzle is written to stdout,\n");
+    fprintf(stderr, "                   and max_solutions defaults to 1\n");
+    fprintf(stderr, "  -a             : batch mode, solved with the async api; text input only\n");
+    fprintf(stderr, "  -H <mb>        : batch result cache of mb megabytes, puzzles that are repeats\n");
+    fprintf(stderr, "                   of earlier ones, or are equivalent by symmetry, are not solved\n");
+    fprintf(stderr, "  -c             : count only, the solutions are not printed\n");
+    fprintf(stderr, "  -g <num>       : generate num minimal puzzles, written to filename (or - for\n");
+    fprintf(stderr, "                   stdout) in the batch line format, or packed with -o packed\n");
+    fprintf(stderr, "  -S <seed>      : generator seed, default is the time\n");
+    fprintf(stderr, "  -y             : count, using the puzzle's symmetries to count one solution\n");
+    fprintf(stderr, "                   of each set of symmetric solutions\n");
+    fprintf(stderr, "  -Y             : as -y, and cross check with the plain count\n");
+    fprintf(stderr, "  -u             : uniqueness check, prints whether the puzzle has no solution,\n");
+    fprintf(stderr, "                   a unique solution, or multiple solutions\n");
+    fprintf(stderr, "  -i <format>    : input format, text (default) or packed\n");
+    fprintf(stderr, "  -o <format>    : output format of the solutions, text (default) or packed\n");
+    fprintf(stderr, "  -O <order>     : order the solutions are written in, any (default) or seq\n");
+    fprintf(stderr, "  -d <depth>     : split depth, branch states down to this depth may be run\n");
+    fprintf(stderr, "                   as tasks by other threads, default 16 for mrv and iter, 3 for dlx\n");
+    fprintf(stderr, "  -e <engine>    : solver engine\n");
+    fprintf(stderr, "                   mrv - propagation, and branching on the location with the\n");
+    fprintf(stderr, "                         minimum remaining values (default)\n");
+    fprintf(stderr, "                   dlx - dancing links (algorithm x) exact cover\n");
+    fprintf(stderr, "                   iter - as mrv, searching iteratively with one board that\n");
+    fprintf(stderr, "                          is changed in place, and undone when backtracking\n");
+    fprintf(stderr, "  -B <heuristic> : branching heuristic of the mrv and iter engines\n");
+    fprintf(stderr, "                   mrv     - the first location with the fewest values, and its\n");
+    fprintf(stderr, "                             values in numeric order (default)\n");
+    fprintf(stderr, "                   degree  - as mrv, ties broken by the most blank locations in\n");
+    fprintf(stderr, "                             the location's units\n");
+    fprintf(stderr, "                   lcv     - as degree, the least constraining value first\n");
+    fprintf(stderr, "                   restart - as lcv, the search for the first solution is\n");
+    fprintf(stderr, "                             restarted with random ties, at a growing node limit\n");
+    fprintf(stderr, "  -s <strategies>: comma seperated list of propagation strategies, run in the\n");
+    fprintf(stderr, "                   order given; naked singles are always run first\n");
+    fprintf(stderr, "                   naked   - naked singles\n");
+    fprintf(stderr, "                   hidden  - hidden singles\n");
+    fprintf(stderr, "                   pairs   - naked pairs\n");
+    fprintf(stderr, "                   triples - naked triples\n");
+    fprintf(stderr, "  -k <kernel>    : naked singles kernel, auto (default), scalar, or avx2;\n");
+    fprintf(stderr, "                   auto selects avx2 when the cpu supports it\n");
+    fprintf(stderr, "  -m <file>      : write metrics to file (or - for stderr), a JSON line\n");
+    fprintf(stderr, "                   every second, or as set by -M\n");
+    fprintf(stderr, "  -M <ms>        : metrics interval, in milliseconds\n");
+    fprintf(stderr, "  -T             : measure the time spent in each strategy\n");
+    fprintf(stderr, "  -C <file>      : checkpoint the solve to file, every 60 secs or as set by -I,\n");
+    fprintf(stderr, "                   when interrupted, and when complete\n");
+    fprintf(stderr, "  -I <secs>      : checkpoint interval, in seconds\n");
+    fprintf(stderr, "  -R             : resume, filename is a checkpoint file written with -C; the\n");
+    fprintf(stderr, "                   solve continues, and is checkpointed to the same file\n");
+    fprintf(stderr, "  -D <port>      : distributed count, listening on port for the workers; the\n");
+    fprintf(stderr, "                   search is expanded to depth, and the branch states are\n");
+    fprintf(stderr, "                   counted by the workers in shards; with -C the count is\n");
+    fprintf(stderr, "                   checkpointed, and it is resumed with -R\n");
+    fprintf(stderr, "  -x <depth>     : distributed count, the depth the search is expanded to,\n");
+    fprintf(stderr, "                   default 6\n");
+    fprintf(stderr, "  -W             : distributed count worker, filename is the coordinator's\n");
+    fprintf(stderr, "                   host:port\n");
+    fprintf(stderr, "  -A             : pin the worker threads to cpus, grouped by numa node; each\n");
+    fprintf(stderr, "                   worker's memory is on its node, and idle workers steal from\n");
+    fprintf(stderr, "                   workers on their own node first\n");
+}
+
+// -----------------  BATCH  ---------------------------------------
+
+// Batch file format ...
+//
+// One puzzle per line, 81 chars, in row order, with '.' or '0' for blank 
+// locations, see sudoku_solve_batch. The results are written to stdout, in 
+// input order.
+//
+// A batch file is memory mapped, and the puzzles are parsed in place. When
+// the input is stdin it is read into a buffer, BATCH_WINDOW_SIZE at a time.
+// The input is given to the solver a window at a time, so that the pages of
+// the mapped file can be released when the window is done.
+
+static void batch_cb(sudoku_ctx_t * ctx, char * out, size_t len)
+{
+    fwrite(out, 1, len, stdout);
+}
+
+static void batch_window(char * start, char * end, char * input, uint64_t input_pos)
+{
+    char * s;
+
+    // solve the window; if it has an invalid puzzle then print the error,
+    // with the line or record number of the puzzle counted from the start 
+    // of the input, and exit; input_pos is the number of lines or records
+    // before input
+    if (sudoku_solve_batch(&ctx, start, end - start) >= 0) {
+        return;
+    }
+    if (ctx.input_format == SUDOKU_FORMAT_PACKED) {
+        input_pos += (start - input) / SUDOKU_PACKED_SIZE;
+    } else {
+        for (s = input; (s = memchr(s, '\n', start - s)) != NULL; s++) {
+            input_pos++;
+        }
+    }
+    fflush(stdout);
+    fprintf(stderr, "ERROR: %s %ld is invalid\n", 
+            ctx.input_format == SUDOKU_FORMAT_PACKED ? "record" : "line",
+            input_pos + ctx.error_pos);
+    exit(1);
+}
+
+void batch_solve(char * filename)
+{
+    int      fd;
+    struct stat st;
+    char   * input=NULL, * buff, * s, * end, str[100];
+    size_t   len, window_len;
+    ssize_t  buff_len, n;
+    bool     eof;
+    uint64_t input_pos=0, start_us, duration_us, rate;
+    double   pct[] = { 50, 90, 99, 99.9 };
+    char   * pct_names[] = { "50", "90", "99", "999" };
+    uint32_t i;
+
+    ctx.batch_cb = batch_cb;
+
+    start_us = microsec_timer();
+    if (async_mode) {
+        // solve the puzzles with the async api
+        async_batch_solve(filename);
+    } else if (strcmp(filename, "-") != 0) {
+        // map the file
+        fd = open(filename, O_RDONLY);
+        if (fd < 0 || fstat(fd, &st) < 0) {
+            perror("open");
+            exit(1);
+        }
+        len = st.st_size;
+        if (len > 0) {
+            input = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (input == MAP_FAILED) {
+                perror("mmap");
+                exit(1);
+            }
+            madvise(input, len, MADV_SEQUENTIAL);
+        }
+        close(fd);
+
+        // solve the windows of the mapped file; the pages of a window are 
+        // released when it is done
+        for (s = input; s < input + len && !ctx.cancel; s = end) {
+            end = sudoku_batch_boundary(&ctx, input, s + BATCH_WINDOW_SIZE, input + len);
+            batch_window(s, end, input, 0);
+            window_len = (end - input) & ~(size_t)(getpagesize() - 1);
+            madvise(input, window_len, MADV_DONTNEED);
+        }
+        if (len > 0) {
+            munmap(input, len);
+        }
+    } else {
+        // read stdin into the buffer, and solve the complete puzzles in the
+        // buffer; the partial puzzle at the end of the buffer is moved to the
+        // start of the buffer for the next read
+        buff = malloc(BATCH_WINDOW_SIZE + 1);
+        if (buff == NULL) {
+            fprintf(stderr, "ERROR: failed to allocate batch buffer\n");
+            exit(1);
+        }
+        buff_len = 0;
+        eof = false;
+        while (!eof && !ctx.cancel) {
+            while (buff_len < BATCH_WINDOW_SIZE) {
+                n = read(0, buff + buff_len, BATCH_WINDOW_SIZE - buff_len);
+                if (n < 0) {
+                    perror("read");
+                    exit(1);
+                }
+                if (n == 0) {
+                    eof = true;
+                    break;
+                }
+                buff_len += n;
+            }
+            if (eof) {
+                end = buff + buff_len;
+            } else if (ctx.input_format == SUDOKU_FORMAT_PACKED) {
+                end = buff + buff_len / SUDOKU_PACKED_SIZE * SUDOKU_PACKED_SIZE;
+            } else {
+                end = memrchr(buff, '\n', buff_len);
+                end = (end == NULL ? buff + buff_len : end + 1);
             }
-            if (ROW(li) == ROW(locidx) ||
-                COL(li) == COL(locidx) ||
-                GRID_NUM(li) == GRID_NUM(locidx))
-            {
-                siblings[locidx][max_sib++] = li;
+            batch_window(buff, end, buff, input_pos);
+            if (ctx.input_format == SUDOKU_FORMAT_PACKED) {
+                input_pos += (end - buff) / SUDOKU_PACKED_SIZE;
+            } else {
+                for (s = buff; (s = memchr(s, '\n', end - s)) != NULL; s++) {
+                    input_pos++;
+                }
             }
+            buff_len -= end - buff;
+            memmove(buff, end, buff_len);
         }
-        assert(max_sib == 20);
+        free(buff);
+    }
+    fflush(stdout);
+    duration_us = microsec_timer() - start_us;
+
+    // print the batch stats
+    rate = ctx.stats.num_puzzles * 1000000L / (duration_us + 1);
+    fprintf(stderr, "num_puzzles        = %s\n", numeric_str(ctx.stats.num_puzzles,str));
+    fprintf(stderr, "num_solved         = %s\n", numeric_str(ctx.stats.num_solved,str));
+    fprintf(stderr, "num_unsolved       = %s\n", numeric_str(ctx.stats.num_puzzles-ctx.stats.num_solved,str));
+    fprintf(stderr, "puzzle_rate        = %s / sec\n", numeric_str(rate,str));
+    if (ctx.cache_memory) {
+        fprintf(stderr, "cache_hits         = %s\n", numeric_str(ctx.stats.cache_hits,str));
+        fprintf(stderr, "cache_misses       = %s\n", numeric_str(ctx.stats.cache_misses,str));
     }
 
-    // init possible-val to val converter
-    for (value = 1; value <= 9; value++) {
-        pv2val[1<<value] = value;
+    // print the puzzle latency percentiles, and the slowest puzzles; the
+    // puzzle number is the line number when the input has no blank or
+    // comment lines
+    if (ctx.stats.num_puzzles == 0) {
+        return;
+    }
+    for (i = 0; i < sizeof(pct)/sizeof(pct[0]); i++) {
+        sprintf(str, "latency_p%s", pct_names[i]);
+        fprintf(stderr, "%-18s = %.1f us\n", str, sudoku_latency_percentile(&ctx.stats, pct[i]) / 1000.);
+    }
+    for (i = 0; i < SUDOKU_MAX_SLOWEST && ctx.stats.slowest[i].id; i++) {
+        fprintf(stderr, "%-18s = puzzle %ld, %.1f us\n", 
+                i == 0 ? "slowest" : "", ctx.stats.slowest[i].id, ctx.stats.slowest[i].ns / 1000.);
     }
 }
 
-// -----------------  FIND SOLUTIONS  ------------------------------
+// The async batch mode (-a) reads the puzzle lines, and submits them as 
+// async requests, keeping up to SUDOKU_ASYNC_QUEUE_SIZE in flight; it waits 
+// for completions by polling the eventfd, and the results are written to
+// stdout in input order, as each request's tag is its puzzle number.
 
-void find_solutions(puzzle_t p, bool new_thread)
+void async_batch_solve(char * filename)
 {
-    uint32_t   locidx, num_pv, pv;
-    uint32_t   best_num_pv, best_locidx=-1, best_pv=-1;
-    uint64_t   ts;
-    uint8_t    trial_val;
-    bool       values_have_been_set;
-    pthread_t  thread_id;
-    puzzle_t * p_copy;
-
-    static pthread_mutex_t thread_create_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-    // if interrupted then return
-    if (sigint_check()) {
-        return;
+    static sudoku_request_t req[SUDOKU_ASYNC_QUEUE_SIZE];
+    static sudoku_request_t * submit[SUDOKU_ASYNC_QUEUE_SIZE];
+    static bool  done[SUDOKU_ASYNC_QUEUE_SIZE];
+    sudoku_request_t * reaped[ASYNC_REAP];
+    FILE   * fp;
+    char   * line = NULL, out[SUDOKU_CELLS+100];
+    size_t   line_size = 0;
+    ssize_t  len;
+    uint64_t line_num = 0, num_read = 0, num_submitted = 0, num_written = 0, id;
+    uint32_t i, n, num_submit = 0, slot;
+    struct pollfd pfd;
+    bool     eof = false;
+
+    // start serving the requests
+    fp = (strcmp(filename, "-") == 0 ? stdin : fopen(filename, "r"));
+    if (fp == NULL) {
+        perror("fopen");
+        exit(1);
     }
-
-    // if the total number of solutions found is at or exceeds the limit then return
-    if (max_solutions != MAX_SOLUTIONS_INFINITE && total_solutions >= max_solutions) {
-        return;
+    pfd.fd = sudoku_async_start(&ctx);
+    pfd.events = POLLIN;
+    if (pfd.fd < 0) {
+        fprintf(stderr, "ERROR: %s\n", ctx.error);
+        exit(1);
     }
 
-    // if not currently executing in a newly created thread and 
-    //    the number of threads running find_solutions is less than maximum 
-    // then
-    //   create a thread which will call find_solutions, and
-    //   return
-    // endif
-    if (!new_thread && num_threads < max_threads) {
-        // acquire the mutex and check again to confirm that a thread needs to be created
-        pthread_mutex_lock(&thread_create_mutex);
-        if (num_threads < max_threads) {
-            // keep track of number of times a thread is created statistic
-            num_thread_creates++;
-
-            // keep track of number of threads that are active;
-            // if this is the first thread created then 
-            //   keep track of the start time statistic
-            // endif
-            if (__sync_fetch_and_add(&num_threads, 1) == 0) {
-                find_solutions_start_us = microsec_timer();
-            }
-
-            // create the new find_solutions_thread
-            p_copy = malloc(sizeof(puzzle_t));
-            *p_copy = p;
-            pthread_create(&thread_id, NULL, find_solutions_thread, p_copy);
-
-            // release the mutex and return
-            pthread_mutex_unlock(&thread_create_mutex);
-            return;
-        }
-
-        // we didn't create the thread, release the mutex and continue
-        pthread_mutex_unlock(&thread_create_mutex);
-    }
-
-    // this section attempts to find a solution by determining
-    // the possible values (pv) for all blank locations; if there
-    // is just one possible value then it is filled in; this 
-    // process repeats until either:
-    // - a location has 0 possible values, in which case the 
-    //   puzzle has no solution, or
-    // - there are no more locations with 1 possible value
-    //
-    // do
-    //   for all blank locations
-    //     determine possible values
-    //     if number of possible values is zero
-    //       return because there is no solution
-    //     else if number of possible values is 1 then
-    //       set the value
-    //     else
-    //       keep track of the location with the least number of
-    //        possible values; this info will be used in the recursion
-    //        code found later in this routine
-    //     endif
-    //   endfor
-    // while one or more values have been set
-    do {
-        best_num_pv = 10;
-        values_have_been_set = false;
-        for (locidx = 0; locidx < 81; locidx++) {
-            if (p.value[locidx] != NO_VALUE) {
+    while (!ctx.cancel && (!eof || num_written < num_read)) {
+        // read puzzles, while there is a free request
+        while (!eof && num_read - num_written < SUDOKU_ASYNC_QUEUE_SIZE) {
+            if ((len = getline(&line, &line_size, fp)) < 0) {
+                eof = true;
+                break;
+            }
+            line_num++;
+            if (len > 0 && line[len-1] == '\n') {
+                len--;
+            }
+            if (len == 0 || (len == 1 && line[0] == '\r') || line[0] == '#') {
                 continue;
             }
-
-            possible_values(&p,locidx,&pv,&num_pv);   
-
-            if (num_pv == 0) {
-                return;
-            } else if (num_pv == 1) {
-                p.value[locidx] = pv2val[pv];
-                p.num_no_value--;
-                values_have_been_set = true;
-            } else if (num_pv < best_num_pv) {
-                best_num_pv = num_pv;
-                best_locidx = locidx;
-                best_pv     = pv;
+            slot = num_read % SUDOKU_ASYNC_QUEUE_SIZE;
+            if (!sudoku_parse_line(line, line + len, &req[slot].puzzle)) {
+                fflush(stdout);
+                fprintf(stderr, "ERROR: line %ld is invalid\n", line_num);
+                exit(1);
             }
+            req[slot].tag = (void*)num_read;
+            done[slot] = false;
+            submit[num_submit++] = &req[slot];
+            num_read++;
         }
-    } while (values_have_been_set);
 
-    // if found a solution then ...
-    if (p.num_no_value == 0) {
-#ifdef VERIFY_SOLUTIONS
-        // verify the solution: if the solution is incorrect then this
-        // is a bug in this program; and the verify_solution routine will
-        // print an error message and exit the program
-        verify_solution(&p);
-#endif
+        // submit them
+        n = sudoku_async_submit(&ctx, submit, num_submit);
+        memmove(submit, submit + n, (num_submit - n) * sizeof(submit[0]));
+        num_submit -= n;
+        num_submitted += n;
 
-        // keep track of the total number of solutions found
-        ts = __sync_add_and_fetch(&total_solutions,1);
-        if (max_solutions != MAX_SOLUTIONS_INFINITE && ts > max_solutions) {
-            __sync_sub_and_fetch(&total_solutions,1);
-            return;
+        // wait for completions, and reap them
+        if (num_submitted == num_written) {
+            continue;
+        }
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+            perror("poll");
+            exit(1);
+        }
+        while ((n = sudoku_async_reap(&ctx, reaped, ASYNC_REAP)) > 0) {
+            for (i = 0; i < n; i++) {
+                id = (uint64_t)reaped[i]->tag;
+                done[id % SUDOKU_ASYNC_QUEUE_SIZE] = true;
+            }
         }
 
-        // print the first solution and 
-        // print subsequent solutions at the print_interval
-        if ((ts % print_interval) == 0 || ts == 1) {
-            print_puzzle(&p, true, ts);
+        // write the results of the completed requests, in input order
+        while (num_written < num_read && done[num_written % SUDOKU_ASYNC_QUEUE_SIZE]) {
+            sudoku_request_t * r = &req[num_written % SUDOKU_ASYNC_QUEUE_SIZE];
+            for (i = 0; i < SUDOKU_CELLS; i++) {
+                out[i] = (r->num_solutions == 0 ? '.' : SUDOKU_VALUE_CHAR(r->solution.value[i]));
+            }
+            len = SUDOKU_CELLS;
+            len += (ctx.max_solutions == 1 ? sprintf(out+len, "\n") : sprintf(out+len, " %ld\n", r->num_solutions));
+            fwrite(out, 1, len, stdout);
+            done[num_written % SUDOKU_ASYNC_QUEUE_SIZE] = false;
+            num_written++;
         }
+    }
 
-        // return
-        return;
+    // stop serving, this waits for the requests in flight when cancelled
+    sudoku_async_stop(&ctx);
+    free(line);
+    if (fp != stdin) {
+        fclose(fp);
     }
+}
 
-    // assert that the above code has set best_num_pv, best_locidx, and best_pv
-    assert(best_num_pv >= 2 && best_num_pv <= 9);
-    assert(best_pv != -1 && best_locidx != -1);
+// -----------------  DISTRIBUTED  ---------------------------------
 
-    // using the locidx with the least number of possible values, recursively
-    // call find_solutions with that location set to each of the possible values
-    // that the location can have
-    p.num_no_value--;
-    for (trial_val = 1; trial_val <= 9; trial_val++) { 
-        if (best_pv & (1 << trial_val)) {
-            p.value[best_locidx] = trial_val;
-            find_solutions(p,false);
+// The distributed mode counts the solutions of a puzzle using worker processes,
+// which may be on other machines, connected by TCP.
+//
+// The coordinator (-D <port>) reads the puzzle, and expands its search to 
+// the depth set by -x (sudoku_expand); or when resuming (-R) it reads the
+// branch states from the checkpoint file. The branch states are divided into
+// shards of DIST_SHARD_STATES, which are sent as packed records to the 
+// workers, up to DIST_WORKER_SHARDS to each worker at a time, so a worker has
+// its next shard when it completes one. The workers count the solutions of 
+// their shards, using the library's engines and thread pool (sudoku_count_states),
+// and return the counts. When a worker's connection fails its shards are 
+// reassigned to the other workers. Workers can connect at any time.
+//
+// A worker sends a heartbeat every DIST_HEARTBEAT_INTERVAL, from its own 
+// thread, while counting; so a worker whose host fails without closing the
+// connection is detected when no message is received from it for 
+// DIST_IO_TIMEOUT, and its shards are reassigned. A shard can take any time
+// to count, so it has no deadline of its own.
+//
+// With -C the coordinator checkpoints the count, every -I seconds, when 
+// interrupted, and when complete: the solutions counted, and the branch states
+// of the shards not yet counted, in the checkpoint file format; so the count
+// can be resumed distributed (-D with -R), or not (-R).
+//
+// The worker (-W) connects to the coordinator at the filename, host:port, 
+// and counts the shards it is sent until the coordinator is done.
+//
+// The messages are dist_msg_t, little endian, and a shard message is 
+// followed by its packed records.
+
+typedef struct {
+    uint32_t magic;                     // DIST_MAGIC
+    uint32_t type;                      // DIST_MSG_xxx
+    uint32_t rec_size;                  // hello: the worker's SUDOKU_PACKED_SIZE
+    uint32_t num_recs;                  // shard: the number of packed records that follow
+    uint64_t shard;                     // shard and result: the shard number
+    uint64_t num_solutions;             // result: the shard's solutions,
+    uint64_t num_nodes;                 //  and the nodes examined counting them
+} dist_msg_t;
+
+typedef struct {
+    uint64_t first;                     // the shard's first branch state
+    uint32_t num_recs;
+    int32_t  state;                     // DIST_SHARD_PENDING, _COUNTED, or the connection it
+} dist_shard_t;                         //  is assigned to
+
+typedef struct {
+    int      fd;                        // -1 when the connection is closed
+    bool     hello;                     // the worker's hello has been received
+    uint32_t num_shards;                // shards assigned to the worker
+    uint64_t shards[DIST_WORKER_SHARDS];
+    uint64_t recv_us;                   // when the last message was received
+    char     name[128];                 // the worker's address
+} dist_conn_t;
+
+static bool dist_io(int fd, void * buff, size_t len, bool send_flag)
+{
+    ssize_t n;
+
+    // send, or receive, all of buff; return false if the connection fails
+    while (len > 0) {
+        n = (send_flag ? send(fd, buff, len, MSG_NOSIGNAL) : recv(fd, buff, len, 0));
+        if (n < 0 && errno == EINTR) {
+            continue;
         }
+        if (n <= 0) {
+            return false;
+        }
+        buff = (char*)buff + n;
+        len -= n;
     }
+    return true;
+}
+
+static bool dist_send(int fd, dist_msg_t * msg, uint8_t * recs)
+{
+    dist_msg_t m;
+
+    // send the message, and for a shard its packed records
+    m.magic         = htole32(DIST_MAGIC);
+    m.type          = htole32(msg->type);
+    m.rec_size      = htole32(msg->rec_size);
+    m.num_recs      = htole32(msg->num_recs);
+    m.shard         = htole64(msg->shard);
+    m.num_solutions = htole64(msg->num_solutions);
+    m.num_nodes     = htole64(msg->num_nodes);
+    return dist_io(fd, &m, sizeof(m), true) &&
+           (recs == NULL || dist_io(fd, recs, (size_t)msg->num_recs * SUDOKU_PACKED_SIZE, true));
 }
 
-void possible_values(puzzle_t * p, uint32_t locidx, uint32_t * pv_arg, uint32_t * num_pv_arg)
+static bool dist_recv(int fd, dist_msg_t * msg)
 {
-    uint32_t * sibs   = siblings[locidx];
-    uint32_t   num_pv = 9;
-    uint32_t   pv     = 0x3fe;
-    uint32_t   i;
-    uint8_t    sib_val;
-
-    // determine the possible values that a location can have;
-    // this routine returns 
-    // - pv_arg: bitmask of the possilbe values
-    // - num_pv_arg: number of possible values, this equals the number of bits
-    //   that are set in pv_arg
-
-    for (i = 0; i < 20; i++) {
-        sib_val = p->value[sibs[i]];
-        if ((sib_val != NO_VALUE) &&
-            (pv & (1 << sib_val)))
-        {
-            pv &= ~(1 << sib_val);
-            num_pv--;
-        }
-    }
-
-    *pv_arg = pv;
-    *num_pv_arg = num_pv;
+    // receive a message, the packed records of a shard are received by the caller
+    if (!dist_io(fd, msg, sizeof(*msg), false) || le32toh(msg->magic) != DIST_MAGIC) {
+        return false;
+    }
+    msg->type          = le32toh(msg->type);
+    msg->rec_size      = le32toh(msg->rec_size);
+    msg->num_recs      = le32toh(msg->num_recs);
+    msg->shard         = le64toh(msg->shard);
+    msg->num_solutions = le64toh(msg->num_solutions);
+    msg->num_nodes     = le64toh(msg->num_nodes);
+    return true;
 }
 
-void * find_solutions_thread(void * cx) 
+static void dist_checkpoint(sudoku_puzzle_t * puzzle, uint64_t num_solutions, uint64_t num_nodes,
+                            uint64_t duration_us, uint8_t * recs, dist_shard_t * shards, uint64_t num_shards)
 {
-    puzzle_t *p = cx;
+    uint8_t * buff;
+    uint64_t  i, n = 0;
+
+    // checkpoint the solutions counted, and the branch states of the shards
+    // not yet counted
+    buff = malloc(num_shards * DIST_SHARD_STATES * SUDOKU_PACKED_SIZE + 1);
+    if (buff == NULL) {
+        fprintf(stderr, "ERROR: failed to allocate checkpoint buffer\n");
+        exit(1);
+    }
+    for (i = 0; i < num_shards; i++) {
+        if (shards[i].state != DIST_SHARD_COUNTED) {
+            memcpy(buff + n * SUDOKU_PACKED_SIZE, recs + shards[i].first * SUDOKU_PACKED_SIZE, 
+                   shards[i].num_recs * SUDOKU_PACKED_SIZE);
+            n += shards[i].num_recs;
+        }
+    }
+    if (sudoku_checkpoint_states(&ctx, puzzle, num_solutions, num_nodes, duration_us, buff, n) < 0) {
+        fprintf(stderr, "ERROR: %s\n", ctx.error);
+        exit(1);
+    }
+    free(buff);
+}
+
+void distrib_coordinator(char * filename)
+{
+    static dist_conn_t conn[DIST_MAX_WORKERS];
+    static struct pollfd pfd[DIST_MAX_WORKERS+1];
+    sudoku_puzzle_t puzzle;
+    dist_shard_t * shards;
+    dist_conn_t  * c;
+    dist_msg_t     msg;
+    uint8_t      * recs;
+    uint64_t      * pending, num_recs, num_shards, num_pending, pending_head = 0, i, j;
+    uint64_t       num_solutions, num_counted = 0, num_nodes = 0, num_reassigned = 0, num_workers = 0;
+    uint64_t       start_us, checkpoint_us;
+    uint32_t       num_conns = 0, num_polled, k;
+    int64_t        n;
+    int            listen_fd, fd, one = 1;
+    struct sockaddr_in addr;
+    socklen_t      addr_len;
+    struct timeval tv = { DIST_IO_TIMEOUT, 0 };
+    char           str[100];
+
+    // get the branch states: from the checkpoint file when resuming, or by
+    // expanding the puzzle's search to the depth
+    start_us = microsec_timer();
+    if (resume) {
+        fprintf(info_fp, "Resuming ...\n");
+        n = sudoku_checkpoint_read_states(&ctx, &puzzle, &recs, &num_recs);
+    } else {
+        read_puzzle(&puzzle, filename);
+        n = sudoku_expand(&ctx, &puzzle, dist_depth, &recs, &num_recs);
+    }
+    if (n < 0) {
+        fprintf(stderr, "ERROR: %s\n", ctx.error);
+        exit(1);
+    }
+    num_solutions = n;
+
+    // divide the branch states into shards, they are all pending
+    num_shards = (num_recs + DIST_SHARD_STATES - 1) / DIST_SHARD_STATES;
+    shards  = calloc(num_shards + 1, sizeof(dist_shard_t));
+    pending = calloc(num_shards + 1, sizeof(uint64_t));
+    if (shards == NULL || pending == NULL) {
+        fprintf(stderr, "ERROR: failed to allocate shards\n");
+        exit(1);
+    }
+    for (i = 0; i < num_shards; i++) {
+        shards[i].first    = i * DIST_SHARD_STATES;
+        shards[i].num_recs = (num_recs - shards[i].first < DIST_SHARD_STATES 
+                              ? num_recs - shards[i].first : DIST_SHARD_STATES);
+        shards[i].state    = DIST_SHARD_PENDING;
+        pending[i] = i;
+    }
+    num_pending = num_shards;
+    fprintf(info_fp, "num_states         = %s\n", numeric_str(num_recs,str));
+    fprintf(info_fp, "num_shards         = %s\n", numeric_str(num_shards,str));
+    fprintf(info_fp, "Counting ...\n");
+    fflush(stdout);
+
+    // listen for the workers
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port        = htons(dist_port);
+    if (listen_fd < 0 ||
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+        bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd, 64) < 0) 
+    {
+        perror("listen");
+        exit(1);
+    }
+
+    // until all shards are counted, or interrupted
+    checkpoint_us = microsec_timer() + ctx.checkpoint_interval * 1000000L;
+    while (num_counted < num_shards && !ctx.cancel) {
+        // assign the pending shards to the workers, a worker whose 
+        // connection fails is closed below
+        for (k = 0; k < num_conns; k++) {
+            c = &conn[k];
+            while (c->fd >= 0 && c->hello && c->num_shards < DIST_WORKER_SHARDS && num_pending > 0) {
+                i = pending[pending_head];
+                memset(&msg, 0, sizeof(msg));
+                msg.type     = DIST_MSG_SHARD;
+                msg.shard    = i;
+                msg.num_recs = shards[i].num_recs;
+                if (!dist_send(c->fd, &msg, recs + shards[i].first * SUDOKU_PACKED_SIZE)) {
+                    close(c->fd);
+                    c->fd = -1;
+                    break;
+                }
+                pending_head = (pending_head + 1) % num_shards;
+                num_pending--;
+                shards[i].state = k;
+                c->shards[c->num_shards++] = i;
+            }
+        }
+
+        // close the failed connections, and reassign their shards
+        for (k = 0; k < num_conns; ) {
+            c = &conn[k];
+            if (c->fd >= 0) {
+                k++;
+                continue;
+            }
+            fprintf(info_fp, "worker %s lost, %d shards reassigned\n", c->name, c->num_shards);
+            for (j = 0; j < c->num_shards; j++) {
+                i = c->shards[j];
+                shards[i].state = DIST_SHARD_PENDING;
+                pending[(pending_head + num_pending++) % num_shards] = i;
+            }
+            num_reassigned += c->num_shards;
+            *c = conn[--num_conns];
+            for (j = 0; j < c->num_shards && k < num_conns; j++) {
+                shards[c->shards[j]].state = k;
+            }
+        }
+
+        // wait for a worker to connect, or a message; the timeout is for 
+        // the checkpoints, and the interrupt
+        pfd[0].fd = listen_fd;
+        pfd[0].events = POLLIN;
+        for (k = 0; k < num_conns; k++) {
+            pfd[k+1].fd = conn[k].fd;
+            pfd[k+1].events = POLLIN;
+        }
+        num_polled = num_conns;
+        if (poll(pfd, num_polled + 1, 1000) < 0 && errno != EINTR) {
+            perror("poll");
+            exit(1);
+        }
+
+        // accept a worker; the timeouts limit the time a failed worker can
+        // stall the coordinator
+        if (pfd[0].revents & POLLIN) {
+            addr_len = sizeof(addr);
+            fd = accept(listen_fd, (struct sockaddr*)&addr, &addr_len);
+            if (fd >= 0 && num_conns == DIST_MAX_WORKERS) {
+                close(fd);
+            } else if (fd >= 0) {
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+                c = &conn[num_conns++];
+                memset(c, 0, sizeof(dist_conn_t));
+                c->fd = fd;
+                c->recv_us = microsec_timer();
+                inet_ntop(AF_INET, &addr.sin_addr, str, sizeof(str));
+                snprintf(c->name, sizeof(c->name), "%s:%d", str, ntohs(addr.sin_port));
+            }
+        }
+
+        // receive the workers' messages: the hello, which is checked to be for
+        // the same board size, and the results of the shards
+        for (k = 0; k < num_polled; k++) {
+            c = &conn[k];
+            if (!(pfd[k+1].revents & (POLLIN|POLLERR|POLLHUP))) {
+                continue;
+            }
+            c->recv_us = microsec_timer();
+            if (!dist_recv(c->fd, &msg)) {
+                close(c->fd);
+                c->fd = -1;
+            } else if (msg.type == DIST_MSG_HEARTBEAT) {
+                // the worker is alive
+            } else if (msg.type == DIST_MSG_HELLO) {
+                c->hello = (msg.rec_size == SUDOKU_PACKED_SIZE);
+                if (!c->hello) {
+                    fprintf(info_fp, "worker %s is for another board size\n", c->name);
+                    close(c->fd);
+                    c->fd = -1;
+                } else {
+                    fprintf(info_fp, "worker %s connected\n", c->name);
+                    num_workers++;
+                }
+            } else if (msg.type == DIST_MSG_RESULT) {
+                for (j = 0; j < c->num_shards && c->shards[j] != msg.shard; j++) {
+                }
+                if (j == c->num_shards) {
+                    close(c->fd);
+                    c->fd = -1;
+                    continue;
+                }
+                c->shards[j] = c->shards[--c->num_shards];
+                shards[msg.shard].state = DIST_SHARD_COUNTED;
+                num_solutions += msg.num_solutions;
+                num_nodes     += msg.num_nodes;
+                num_counted++;
+            } else {
+                close(c->fd);
+                c->fd = -1;
+            }
+        }
 
-    // find solutions
-    find_solutions(*p, true);
+        // close the connections of the workers not heard from, their shards
+        // are reassigned above
+        for (k = 0; k < num_conns; k++) {
+            c = &conn[k];
+            if (c->fd >= 0 && microsec_timer() - c->recv_us > DIST_IO_TIMEOUT * 1000000L) {
+                fprintf(info_fp, "worker %s timed out\n", c->name);
+                close(c->fd);
+                c->fd = -1;
+            }
+        }
 
-    // keep track of number of threads that are active; and
-    // if this is the last thread that is exitting then
-    //   keep track of the completion time statistic, and
-    //   set the find_solutions_done flag
-    // endif
-    if (__sync_sub_and_fetch(&num_threads, 1) == 0) {
-        find_solutions_end_us = microsec_timer();
-        __sync_synchronize();
-        find_solutions_done = true;
+        // checkpoint every checkpoint_interval
+        if (ctx.checkpoint_file && microsec_timer() >= checkpoint_us) {
+            dist_checkpoint(&puzzle, num_solutions, num_nodes, microsec_timer() - start_us, 
+                            recs, shards, num_shards);
+            checkpoint_us = microsec_timer() + ctx.checkpoint_interval * 1000000L;
+        }
     }
 
-    // free cx arg
-    free(cx);
+    // tell the workers the count is done, and checkpoint the count, it is
+    // complete unless interrupted
+    memset(&msg, 0, sizeof(msg));
+    msg.type = DIST_MSG_DONE;
+    for (k = 0; k < num_conns; k++) {
+        if (conn[k].fd >= 0) {
+            dist_send(conn[k].fd, &msg, NULL);
+            close(conn[k].fd);
+        }
+    }
+    close(listen_fd);
+    if (ctx.checkpoint_file) {
+        dist_checkpoint(&puzzle, num_solutions, num_nodes, microsec_timer() - start_us, 
+                        recs, shards, num_shards);
+    }
+
+    // the stats printed by main are the distributed count's
+    ctx.stats.total_solutions = num_solutions;
+    ctx.stats.num_nodes      += num_nodes;
+    ctx.stats.duration_us     = microsec_timer() - start_us;
+    fprintf(info_fp, "num_workers        = %ld\n", num_workers);
+    fprintf(info_fp, "num_reassigned     = %ld\n", num_reassigned);
+    free(shards);
+    free(pending);
+    free(recs);
+}
 
-    // return
+static int             dist_worker_fd;
+static bool            dist_worker_done;
+static pthread_mutex_t dist_worker_mutex = PTHREAD_MUTEX_INITIALIZER;  // serializes the sends, and
+static pthread_cond_t  dist_worker_cond  = PTHREAD_COND_INITIALIZER;   //  signals dist_worker_done
+
+static void * dist_heartbeat_thread(void * cx)
+{
+    struct timespec ts;
+    dist_msg_t      msg;
+
+    // send a heartbeat every DIST_HEARTBEAT_INTERVAL, until the worker is done;
+    // a failed send is detected by the worker's receive
+    memset(&msg, 0, sizeof(msg));
+    msg.type = DIST_MSG_HEARTBEAT;
+    pthread_mutex_lock(&dist_worker_mutex);
+    while (!dist_worker_done) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += DIST_HEARTBEAT_INTERVAL;
+        while (!dist_worker_done &&
+               pthread_cond_timedwait(&dist_worker_cond, &dist_worker_mutex, &ts) == 0) ;
+        if (!dist_worker_done) {
+            dist_send(dist_worker_fd, &msg, NULL);
+        }
+    }
+    pthread_mutex_unlock(&dist_worker_mutex);
     return NULL;
 }
 
+void distrib_worker(char * hostport)
+{
+    struct addrinfo hints, * ai;
+    dist_msg_t msg;
+    uint8_t  * recs = NULL;
+    uint64_t   num_nodes, num_shards = 0, recs_alloc = 0;
+    int64_t    n;
+    int        fd, one = 1;
+    bool       ok;
+    char       host[200], * port;
+    pthread_t  heartbeat_thread_id;
+
+    // connect to the coordinator, and send the hello
+    snprintf(host, sizeof(host), "%s", hostport);
+    port = strrchr(host, ':');
+    if (port == NULL) {
+        usage();
+        exit(1);
+    }
+    *port++ = '\0';
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if ((n = getaddrinfo(host, port, &hints, &ai)) != 0) {
+        fprintf(stderr, "ERROR: %s, %s\n", hostport, gai_strerror(n));
+        exit(1);
+    }
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0 || connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+        perror("connect");
+        exit(1);
+    }
+    freeaddrinfo(ai);
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+    memset(&msg, 0, sizeof(msg));
+    msg.type     = DIST_MSG_HELLO;
+    msg.rec_size = SUDOKU_PACKED_SIZE;
+    if (!dist_send(fd, &msg, NULL)) {
+        fprintf(stderr, "ERROR: lost the coordinator\n");
+        exit(1);
+    }
+    fprintf(info_fp, "Counting shards ...\n");
+    fflush(stdout);
+    dist_worker_fd = fd;
+    pthread_create(&heartbeat_thread_id, NULL, dist_heartbeat_thread, NULL);
+
+    // count the shards, until the coordinator is done; when interrupted 
+    // the shard's result is not sent, the coordinator reassigns it
+    while (!ctx.cancel) {
+        if (!dist_recv(fd, &msg)) {
+            fprintf(stderr, "ERROR: lost the coordinator\n");
+            exit(1);
+        }
+        if (msg.type == DIST_MSG_DONE) {
+            break;
+        }
+        if (msg.type != DIST_MSG_SHARD) {
+            fprintf(stderr, "ERROR: invalid message from the coordinator\n");
+            exit(1);
+        }
+        if (msg.num_recs > recs_alloc) {
+            recs_alloc = msg.num_recs;
+            recs = realloc(recs, recs_alloc * SUDOKU_PACKED_SIZE);
+            if (recs == NULL) {
+                fprintf(stderr, "ERROR: failed to allocate shard\n");
+                exit(1);
+            }
+        }
+        if (!dist_io(fd, recs, (size_t)msg.num_recs * SUDOKU_PACKED_SIZE, false)) {
+            fprintf(stderr, "ERROR: lost the coordinator\n");
+            exit(1);
+        }
+        num_nodes = ctx.stats.num_nodes;
+        n = sudoku_count_states(&ctx, recs, msg.num_recs);
+        if (ctx.cancel) {
+            break;
+        }
+        if (n < 0) {
+            fprintf(stderr, "ERROR: shard %ld, %s\n", msg.shard, ctx.error);
+            exit(1);
+        }
+        msg.type          = DIST_MSG_RESULT;
+        msg.num_solutions = n;
+        msg.num_nodes     = ctx.stats.num_nodes - num_nodes;
+        pthread_mutex_lock(&dist_worker_mutex);
+        ok = dist_send(fd, &msg, NULL);
+        pthread_mutex_unlock(&dist_worker_mutex);
+        if (!ok) {
+            fprintf(stderr, "ERROR: lost the coordinator\n");
+            exit(1);
+        }
+        num_shards++;
+    }
+    pthread_mutex_lock(&dist_worker_mutex);
+    dist_worker_done = true;
+    pthread_cond_signal(&dist_worker_cond);
+    pthread_mutex_unlock(&dist_worker_mutex);
+    pthread_join(heartbeat_thread_id, NULL);
+    close(fd);
+    free(recs);
+    fprintf(info_fp, "num_shards         = %ld\n", num_shards);
+}
+
+// -----------------  GENERATE  ------------------------------------
+
+// The generated puzzles are written to stdout, or the file, in the batch line
+// format; they can be solved with batch mode.
+
+void generate_puzzles(char * filename)
+{
+    char     str[100];
+    uint64_t start_us, duration_us, rate;
+
+    if (strcmp(filename, "-") != 0 && freopen(filename, "w", stdout) == NULL) {
+        perror("freopen");
+        exit(1);
+    }
+    ctx.batch_cb = batch_cb;
+
+    start_us = microsec_timer();
+    sudoku_generate(&ctx, generate, generate_seed);
+    fflush(stdout);
+    duration_us = microsec_timer() - start_us;
+
+    // print the generate stats
+    rate = ctx.stats.num_puzzles * 1000000L / (duration_us + 1);
+    fprintf(stderr, "num_puzzles        = %s\n", numeric_str(ctx.stats.num_puzzles,str));
+    fprintf(stderr, "avg_clues          = %.2f\n", 
+            (double)ctx.stats.num_clues / (ctx.stats.num_puzzles ? ctx.stats.num_puzzles : 1));
+    fprintf(stderr, "puzzle_rate        = %s / sec\n", numeric_str(rate,str));
+}
+
 // -----------------  READ & PRINT PUZZLE  -------------------------
 
 // File format ...
@@ -420,18 +1438,18 @@ void * find_solutions_thread(void * cx)
 // |       |       | 5   3 |
 // +-------+-------+-------+
 
-void read_puzzle(puzzle_t * p, char * filename)
+void read_puzzle(sudoku_puzzle_t * p, char * filename)
 {
     FILE   * fp;
-    char     s[100];
+    char     s[200];
     size_t   len;
     uint32_t locidx=0, line_num=0;
-    uint32_t gli_tblidx, rli, cli, gli;
-    uint32_t gli_tbl[9] = { 0, 3, 6, 27, 30, 33, 54, 57, 60 };
+    uint32_t col, unit, kind, i, v, mask;
+    char   * unit_names[3] = { "row", "col", "grid" };
 
     #define LINE_ERROR\
         do { \
-            printf("ERROR: line %d is invalid\n", line_num); \
+            fprintf(stderr, "ERROR: line %d is invalid\n", line_num); \
             exit(1); \
         } while (0)
 
@@ -439,41 +1457,19 @@ void read_puzzle(puzzle_t * p, char * filename)
         do { \
             char c = s[x]; \
             if (c == ' ') { \
-                p->value[locidx++] = NO_VALUE; \
-            } else if (c >= '1' && c <= '9') { \
-                p->value[locidx++] = c - '0'; \
+                p->value[locidx++] = SUDOKU_NO_VALUE; \
+            } else if (SUDOKU_CHAR_VALUE(c) != 0) { \
+                p->value[locidx++] = SUDOKU_CHAR_VALUE(c); \
                 p->num_no_value--; \
             } else { \
                 LINE_ERROR; \
             } \
         } while (0)
 
-    #define CHECK2(a,b,c,d,e,f,g,h,i, err_fmt, err_val) \
-        do {  \
-            uint8_t vals[9] = { p->value[a], p->value[b], p->value[c], \
-                                p->value[d], p->value[e], p->value[f], \
-                                p->value[g], p->value[h], p->value[i] }; \
-            uint32_t mask=0, ii; \
-            for (ii = 0; ii < 9; ii++) { \
-                if (vals[ii] >= 1 && vals[ii] <= 9) { \
-                    if (mask & (1 << vals[ii])) { \
-                        printf("ERROR: invalid problem - " err_fmt " %d\n", err_val); \
-                        exit(1); \
-                    } \
-                    mask |= (1 << vals[ii]); \
-                } else if (vals[ii] == NO_VALUE) { \
-                    /* okay */ \
-                } else { \
-                    printf("ERROR: invalid problem - " err_fmt " %d\n", err_val); \
-                    exit(1); \
-                } \
-            } \
-        } while (0)
-
-    // init an empty puzzle, with all locations set to NO_VALUE
-    p->num_no_value = 81;
-    for (locidx = 0; locidx < 81; locidx++) {
-        p->value[locidx] = NO_VALUE;
+    // init an empty puzzle, with all locations set to SUDOKU_NO_VALUE
+    p->num_no_value = SUDOKU_CELLS;
+    for (locidx = 0; locidx < SUDOKU_CELLS; locidx++) {
+        p->value[locidx] = SUDOKU_NO_VALUE;
     }
     
     // open file
@@ -483,9 +1479,18 @@ void read_puzzle(puzzle_t * p, char * filename)
         exit(1);
     }
 
+    // if the input format is packed then read the first record of the file
+    if (ctx.input_format == SUDOKU_FORMAT_PACKED) {
+        uint8_t rec[SUDOKU_PACKED_SIZE];
+        if (fread(rec, 1, SUDOKU_PACKED_SIZE, fp) != SUDOKU_PACKED_SIZE || !sudoku_unpack(rec, p)) {
+            fprintf(stderr, "ERROR: packed record is invalid\n");
+            exit(1);
+        }
+    }
+
     // read lines from file
     locidx = 0;
-    while (fgets(s, sizeof(s), fp) != NULL) {
+    while (ctx.input_format == SUDOKU_FORMAT_TEXT && fgets(s, sizeof(s), fp) != NULL) {
         // keep track of line_num
         line_num++;
 
@@ -501,24 +1506,19 @@ void read_puzzle(puzzle_t * p, char * filename)
             continue;
         }
 
-        // verify line length
-        if (len != 25) {
+        // verify line length, 25 for 9x9
+        if (len != 2 * SUDOKU_N + 2 * SUDOKU_BOX + 1) {
             LINE_ERROR;
         }
         
-        // process chars at appropriate positions within the input line
-        PROCESS_CHAR(2);
-        PROCESS_CHAR(4);
-        PROCESS_CHAR(6);
-        PROCESS_CHAR(10);
-        PROCESS_CHAR(12);
-        PROCESS_CHAR(14);
-        PROCESS_CHAR(18);
-        PROCESS_CHAR(20);
-        PROCESS_CHAR(22);
+        // process chars at appropriate positions within the input line, 
+        // 2, 4, 6, 10, ... for 9x9
+        for (col = 0; col < SUDOKU_N; col++) {
+            PROCESS_CHAR(2 + 2 * col + 2 * (col / SUDOKU_BOX));
+        }
 
         // if done then break
-        if (locidx == 81) {
+        if (locidx == SUDOKU_CELLS) {
             break;
         }
     }
@@ -527,152 +1527,42 @@ void read_puzzle(puzzle_t * p, char * filename)
     fclose(fp);
 
     // print puzzle
-    print_puzzle(p, false, 0);
-
-    // verify puzzle is valid by checking for presence of 1..9 or NO_VALUE in 
-    // each row, column and grid, and no duplicates
-    for (rli = 0; rli < 81; rli += 9) {
-        CHECK2(rli+0, rli+1, rli+2, rli+3, rli+4, rli+5, rli+6, rli+7, rli+8, 
-              "row", ROW(rli));
-    }
-    for (cli = 0; cli < 9; cli++) {
-        CHECK2(cli+0, cli+9, cli+18, cli+27, cli+36, cli+45, cli+54, cli+63, cli+72, 
-              "col", COL(cli));
-    }
-    for (gli_tblidx = 0; gli_tblidx < 9; gli_tblidx++) {
-        gli = gli_tbl[gli_tblidx];
-        CHECK2(gli+0, gli+1, gli+2, gli+9, gli+10, gli+11, gli+18, gli+19, gli+20,
-              "grid", gli_tblidx);             
-    }
-}
-
-void print_puzzle(puzzle_t * p, bool print_stats, uint64_t ts)
-{
-    uint32_t line, row=0;
-    uint64_t us, rate;
-    char s[100];
-
-    static pthread_mutex_t print_puzzle_mutex = PTHREAD_MUTEX_INITIALIZER;
-    static uint64_t last_us, last_ts;
-
-    pthread_mutex_lock(&print_puzzle_mutex);
-
-    for (line = 0; line <= 12; line++) {
-        if (line == 0 || line == 4 || line == 8 || line == 12) {
-            printf("+-------+-------+-------+");
-        } else {
-            uint8_t * v = &p->value[row*9];
-            printf("| %c %c %c | %c %c %c | %c %c %c |",
-                v[0] == NO_VALUE ? ' ' : v[0] + '0',
-                v[1] == NO_VALUE ? ' ' : v[1] + '0',
-                v[2] == NO_VALUE ? ' ' : v[2] + '0',
-                v[3] == NO_VALUE ? ' ' : v[3] + '0',
-                v[4] == NO_VALUE ? ' ' : v[4] + '0',
-                v[5] == NO_VALUE ? ' ' : v[5] + '0',
-                v[6] == NO_VALUE ? ' ' : v[6] + '0',
-                v[7] == NO_VALUE ? ' ' : v[7] + '0',
-                v[8] == NO_VALUE ? ' ' : v[8] + '0');
-            row++;
-        }
-
-        if (print_stats) {
-            if (line == 0) {
-                printf(" total_solutions     = %s", numeric_str(ts,s));
-            }
-            if (line == 1) {
-                printf(" num_thread_creates  = %d", num_threads);
-            }
-            if (line == 2) {
-                us = microsec_timer();
-                if (last_us != 0) {
-                    rate = (ts - last_ts) * 1000000L / (us - last_us);
-                    last_ts = ts;
-                    last_us = us;
-                    printf(" solutions_rate      = %s / sec", numeric_str(rate,s));        
-                } else {
-                    last_us = us;
-                    last_ts = ts;
+    print_puzzle(p);
+
+    // verify puzzle is valid by checking for no duplicates in each row, 
+    // column and grid; the values read are 1..SUDOKU_N or SUDOKU_NO_VALUE
+    for (kind = 0; kind < 3; kind++) {
+        for (unit = 0; unit < SUDOKU_N; unit++) {
+            mask = 0;
+            for (i = 0; i < SUDOKU_N; i++) {
+                locidx = (kind == 0 ? unit * SUDOKU_N + i :
+                          kind == 1 ? i * SUDOKU_N + unit :
+                          (unit / SUDOKU_BOX * SUDOKU_BOX + i / SUDOKU_BOX) * SUDOKU_N + 
+                          unit % SUDOKU_BOX * SUDOKU_BOX + i % SUDOKU_BOX);
+                v = p->value[locidx];
+                if (v == SUDOKU_NO_VALUE) {
+                    continue;
                 }
+                if (mask & (1 << v)) {
+                    fprintf(stderr, "ERROR: invalid problem - %s %d\n", unit_names[kind], unit);
+                    exit(1);
+                }
+                mask |= (1 << v);
             }
         }
-
-        printf("\n");
     }
-    printf("\n");
-
-    pthread_mutex_unlock(&print_puzzle_mutex);
 }
 
-// -----------------  VERIFY SLUTION  ------------------------------
-
-#ifdef VERIFY_SOLUTIONS
-void verify_solution(puzzle_t * p) 
+void print_puzzle(sudoku_puzzle_t * p)
 {
-    uint32_t gli_tblidx;
-    uint32_t rli, cli, gli;
-    uint32_t gli_tbl[9] = { 0, 3, 6, 27, 30, 33, 54, 57, 60 };
-
-    #define CHECK(a,b,c,d,e,f,g,h,i, err_fmt, err_val) \
-        do { \
-            uint32_t v = (1 << p->value[a]) | (1 << p->value[b]) | (1 << p->value[c]) | \
-                         (1 << p->value[d]) | (1 << p->value[e]) | (1 << p->value[f]) | \
-                         (1 << p->value[g]) | (1 << p->value[h]) | (1 << p->value[i]); \
-            if (v != 0x3fe) { \
-                printf("ERROR: invalid soution - " err_fmt " %d\n", err_val); \
-                exit(1); \
-            } \
-        } while (0)
-
-    #define MAX_PRIOR_CHECKED_SOLUTIONS 1000000
-    static puzzle_t prior_checked_solutions[MAX_PRIOR_CHECKED_SOLUTIONS];
-    static uint32_t max_prior_checked_solutions;
-    uint32_t i;
-    static pthread_mutex_t verify_solution_mutex = PTHREAD_MUTEX_INITIALIZER;
+    char s[SUDOKU_MAX_FORMAT];
+    uint32_t len;
 
-    // if the solution is incorrect (indicates a program bug) then
-    // - print error message
-    // - exit this prgram
-
-    // verify solution is correct, by checking for presence of 1..9 in 
-    // each row, column and grid
-    for (rli = 0; rli < 81; rli += 9) {
-        CHECK(rli+0, rli+1, rli+2, rli+3, rli+4, rli+5, rli+6, rli+7, rli+8, 
-              "row", ROW(rli));
-    }
-    for (cli = 0; cli < 9; cli++) {
-        CHECK(cli+0, cli+9, cli+18, cli+27, cli+36, cli+45, cli+54, cli+63, cli+72, 
-              "col", COL(cli));
-    }
-    for (gli_tblidx = 0; gli_tblidx < 9; gli_tblidx++) {
-        gli = gli_tbl[gli_tblidx];
-        CHECK(gli+0, gli+1, gli+2, gli+9, gli+10, gli+11, gli+18, gli+19, gli+20,
-              "grid", gli_tblidx);             
-    }
-
-    // check if this solution has already been found, and
-    // remember this solution so it can be compared with future solutions
-    for (i = 0; i < max_prior_checked_solutions; i++) {
-        if (memcmp(p, &prior_checked_solutions[i], sizeof(puzzle_t)) == 0) {
-            printf("ERROR: this solution is a duplicate, exitting\n");
-            exit(1);
-        }
-    }
-    pthread_mutex_lock(&verify_solution_mutex);
-    if (max_prior_checked_solutions == MAX_PRIOR_CHECKED_SOLUTIONS) {
-        static bool warning_printed = false;
-        if (warning_printed == false) {
-            printf("WARNING: too many solutions to continue checking for duplicates\n");
-            warning_printed = true;
-        }
-    } else {
-        prior_checked_solutions[max_prior_checked_solutions] = *p;
-        __sync_synchronize();
-        max_prior_checked_solutions++;
-        __sync_synchronize();
-    }
-    pthread_mutex_unlock(&verify_solution_mutex);
+    // print the puzzle with a single fwrite, so that it is not
+    // interleaved with other output
+    len = sudoku_format_puzzle(NULL, p, 0, s);
+    fwrite(s, 1, len, info_fp);
 }
-#endif
 
 // -----------------  UTILS - TIME  --------------------------------
 
@@ -686,8 +1576,6 @@ uint64_t microsec_timer(void)
 
 // -----------------  UTILS - SIGINT  ------------------------------
 
-bool ctrl_c;
-
 void sigint_handler(int sig);
 
 void sigint_register(void)
@@ -701,17 +1589,7 @@ void sigint_register(void)
 
 void sigint_handler(int sig)
 {
-    ctrl_c = true;
-}
-
-bool sigint_check(void)
-{
-    return ctrl_c;
-}
-
-void sigint_clear(void)
-{
-    ctrl_c = false;
+    ctx.cancel = true;
 }
 
 // -----------------  UTILS - NUMBER TO STRING  --------------------
@@ -0,0 +1,344 @@
+/*
+Copyright (c) 2017 Steven Haid
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __SUDOKU_H__
+#define __SUDOKU_H__
+
+// libsudoku - the sudoku solver library
+//
+// The state of a solver is in a context. The caller sets the config of the
+// context, with sudoku_defaults and then its own values, and calls
+// sudoku_create to create the context's pool of worker threads. A context
+// solves one puzzle, or batch of puzzles, at a time; contexts are
+// independent, so separate contexts can be used to solve concurrently.
+//
+// Usage example:
+//
+//     sudoku_ctx_t ctx;
+//     sudoku_puzzle_t puzzle, solution;
+//     sudoku_defaults(&ctx);
+//     ctx.max_threads = 8;
+//     if (sudoku_create(&ctx) < 0) {
+//         printf("ERROR: %s\n", ctx.error);
+//     }
+//     ...
+//     if (sudoku_solve_one(&ctx, &puzzle, &solution) > 0) {
+//         ...
+//     }
+//     sudoku_destroy(&ctx);
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+//
+// defines
+//
+
+// the board size is set at compile time: SUDOKU_BOX is the width of a box,
+// 3 for 9x9 boards (the default), 4 for 16x16, or 5 for 25x25; the library 
+// and its callers must be compiled with the same SUDOKU_BOX, see the Makefile
+#ifndef SUDOKU_BOX
+#define SUDOKU_BOX                     3
+#endif
+#if SUDOKU_BOX < 3 || SUDOKU_BOX > 5
+#error "SUDOKU_BOX must be 3, 4, or 5"
+#endif
+#define SUDOKU_N                       (SUDOKU_BOX * SUDOKU_BOX)    // values are 1 to N, and a unit has N locations
+#define SUDOKU_CELLS                   (SUDOKU_N * SUDOKU_N)        // number of locations
+
+#define SUDOKU_NO_VALUE                255     // value of a blank location
+#define SUDOKU_MAX_SOLUTIONS_INFINITE  0
+#define SUDOKU_PACKED_SIZE             (SUDOKU_N <= 9 ? (SUDOKU_CELLS + 1) / 2 : SUDOKU_CELLS + 1) 
+                                               // size of a packed record, 41 bytes for 9x9
+#define SUDOKU_MAX_FORMAT              ((SUDOKU_N + SUDOKU_BOX + 2) * 128)
+                                               // max length of sudoku_format_puzzle output
+
+// the text formats have the values 1 to 9 as '1' to '9', and 10 to 25 as 'A' to 'P';
+// SUDOKU_CHAR_VALUE is 0 for a char that is not a value
+#define SUDOKU_VALUE_CHAR(v)           ((v) <= 9 ? '0' + (v) : 'A' + (v) - 10)
+#define SUDOKU_CHAR_VALUE(c)           ((c) >= '1' && (c) <= '9' ? (c) - '0' : \
+                                        (c) >= 'A' && (c) < 'A' + SUDOKU_N - 9 ? (c) - 'A' + 10 : 0)
+
+#define SUDOKU_ENGINE_MRV              0       // propagation and MRV branching
+#define SUDOKU_ENGINE_DLX              1       // dancing links exact cover
+#define SUDOKU_ENGINE_ITER             2       // propagation and MRV branching, iterative with undo
+
+#define SUDOKU_FORMAT_TEXT             0       // box format file, or batch lines
+#define SUDOKU_FORMAT_PACKED           1       // packed binary records, 4 bits per location
+
+#define SUDOKU_ORDER_ANY               0       // solutions written as soon as they are found
+#define SUDOKU_ORDER_SEQ               1       // solutions written in solution number order
+
+#define SUDOKU_UNIQUE_NONE             0       // sudoku_unique results: no solution, 
+#define SUDOKU_UNIQUE_ONE              1       //  a unique solution, 
+#define SUDOKU_UNIQUE_MULTIPLE         2       //  more than one solution
+
+#define SUDOKU_KERNEL_AUTO             0       // selected by cpu feature detection
+#define SUDOKU_KERNEL_SCALAR           1       // naked singles kernel, one location at a time
+#define SUDOKU_KERNEL_AVX2             2       // naked singles kernel, 16 locations at a time
+
+#define SUDOKU_HEURISTIC_MRV           0       // branch on the first location with the fewest values, 
+                                               //  trying its values in order
+#define SUDOKU_HEURISTIC_DEGREE        1       // as mrv, ties broken by the most blank locations in its units
+#define SUDOKU_HEURISTIC_LCV           2       // as degree, trying the least constraining value first
+#define SUDOKU_HEURISTIC_RESTART       3       // as lcv, with randomized restarts when finding the
+                                               //  first solution
+
+#define SUDOKU_MAX_STRATEGY            4
+#define SUDOKU_MAX_HEURISTIC           4
+#define SUDOKU_MAX_TASK_SIZE_HIST      24      // task size histogram buckets, see sudoku_stats_t
+#define SUDOKU_MAX_LATENCY_HIST        608     // batch puzzle latency histogram buckets, see sudoku_stats_t
+#define SUDOKU_MAX_SLOWEST             10      // slowest batch puzzles kept, see sudoku_stats_t
+#define SUDOKU_ASYNC_QUEUE_SIZE        4096    // async requests in flight, see sudoku_async_submit
+
+//
+// typedefs
+//
+
+typedef struct {
+    uint8_t value[SUDOKU_CELLS];        // 1 to SUDOKU_N, or SUDOKU_NO_VALUE, in row order
+    uint32_t num_no_value;
+} sudoku_puzzle_t;
+
+typedef struct {
+    uint64_t calls;
+    uint64_t changes;                   // number of values set or eliminated
+    uint64_t contradictions;            // number of branch states found to have no solution
+    uint64_t ns;                        // time spent, when strategy_timing is enabled
+} sudoku_strategy_stats_t;
+
+typedef struct {
+    uint64_t id;                        // the puzzle number, see sudoku_stats_t
+    uint64_t ns;                        // time spent solving the puzzle
+} sudoku_slowest_t;
+
+typedef struct {
+    sudoku_puzzle_t puzzle;             // set by the caller: the puzzle,
+    void          * tag;                //  and the caller's data, unchanged by the solver
+    sudoku_puzzle_t solution;           // set when the request completes: the first solution,
+    uint64_t        num_solutions;      //  when num_solutions is not 0, up to ctx->max_solutions
+} sudoku_request_t;
+
+typedef struct {
+    uint64_t total_solutions;           // of all the solves of the context
+    uint64_t num_thread_creates;
+    uint64_t num_tasks;
+    uint64_t num_steals;
+    uint64_t num_remote_steals;         // of the steals, those from a worker on another numa node
+    uint64_t num_nodes;
+    uint64_t num_puzzles;               // batch puzzles, and async requests, solved; or puzzles generated
+    uint64_t num_solved;                // batch puzzles that have a solution
+    uint64_t num_clues;                 // clues of the puzzles generated
+    uint64_t duration_us;               // time spent solving
+    sudoku_strategy_stats_t strategy_stats[SUDOKU_MAX_STRATEGY];
+    uint64_t task_size_hist[SUDOKU_MAX_TASK_SIZE_HIST];  // number of tasks by the number of nodes
+                                        //  they examined; bucket n is 2^n to 2^(n+1)-1 nodes,
+                                        //  and the last bucket is the larger tasks
+    uint64_t max_task_size;             // nodes examined by the largest task
+    uint64_t cache_hits;                // batch puzzles found in the result cache,
+    uint64_t cache_misses;              //  and not found, or not cached
+    uint64_t symmetry_factor;           // sudoku_count_symmetric, the size of the symmetry group,
+    uint64_t symmetry_states;           //  and the number of branch states searched
+    uint64_t heuristic_nodes[SUDOKU_MAX_HEURISTIC];  // nodes examined by the mrv and iter engines,
+                                        //  by the branching heuristic used
+    uint64_t num_restarts;              // searches restarted by the restart heuristic
+    uint64_t latency_hist[SUDOKU_MAX_LATENCY_HIST];  // number of batch puzzles, and async requests,
+                                        //  by the time spent solving each, in log linear ns 
+                                        //  buckets: 16 buckets for each power of 2, see
+                                        //  sudoku_latency_percentile
+    sudoku_slowest_t slowest[SUDOKU_MAX_SLOWEST];    // the slowest batch puzzles, slowest first;
+                                        //  the id is the puzzle number, counting the batch puzzles
+                                        //  of the context from 1, and is 0 for unused entries
+    uint64_t num_checkpoints;           // checkpoints written
+    uint64_t checkpoint_states;         // branch states in the last checkpoint written, 0 when
+                                        //  it is of a completed solve
+} sudoku_stats_t;
+
+typedef struct sudoku_ctx sudoku_ctx_t;
+
+struct sudoku_ctx {
+    // config, set before sudoku_create
+    uint32_t max_threads;
+    bool     affinity;                  // pin the worker threads to cpus, grouped by numa node, and
+                                        //  keep each worker's memory on its node
+    uint32_t print_interval;            // solutions output at this interval, and the first
+    uint64_t max_solutions;             // of each solve, or SUDOKU_MAX_SOLUTIONS_INFINITE
+    uint32_t engine;
+    uint32_t heuristic;                 // branching heuristic of the mrv and iter engines, it
+                                        //  may be changed between solves
+    uint32_t kernel;                    // set to the kernel selected, by sudoku_create
+    uint32_t split_depth;               // branch states down to this depth may become tasks,
+                                        //  deeper ones are searched serially; 0 selects the
+                                        //  engine's default, and is set to it by sudoku_create
+    char   * strategies;                // comma seperated list of propagation strategies
+    bool     strategy_timing;
+    uint32_t input_format;              // of sudoku_solve_batch input
+    uint32_t output_format;             // of the solutions output
+    uint32_t output_order;              // of the solutions written to output_fd
+    int      output_fd;                 // sudoku_solve_one solutions are written here, -1 for none
+    int      metrics_fd;                // metrics JSON lines are written here, -1 for none,
+    uint32_t metrics_interval_ms;       //  at this interval; when a write fails the error is
+                                        //  set, and the metrics stop, the solves continue
+    uint64_t cache_memory;              // batch results are cached in this many bytes, by the
+                                        //  canonical form of the puzzle; 0 for no cache
+    char   * checkpoint_file;           // the solve is checkpointed to this file, NULL for none,
+    uint32_t checkpoint_interval;       //  every checkpoint_interval seconds, when cancelled, and
+                                        //  when it completes; see sudoku_resume
+
+    // callbacks, optional
+    // - solution_cb: called by the worker threads, concurrently, for the
+    //   solutions of sudoku_solve_one at the print_interval
+    // - batch_cb: called with the results of sudoku_solve_batch, in input order
+    void   (*solution_cb)(sudoku_ctx_t * ctx, uint64_t num, sudoku_puzzle_t * solution);
+    void   (*batch_cb)(sudoku_ctx_t * ctx, char * out, size_t len);
+    void   * cb_arg;
+
+    // set to cancel the solve in progress
+    volatile bool cancel;
+
+    // set by sudoku_create: the propagation strategies in the order run
+    uint32_t pipeline[SUDOKU_MAX_STRATEGY];
+    uint32_t max_pipeline;
+
+    // stats, updated when a solve completes
+    sudoku_stats_t stats;
+
+    // set when a call fails; error_pos is the line, or record, of an invalid
+    // batch puzzle, counted from 1 at the start of the input
+    char     error[100];
+    uint64_t error_pos;
+
+    // private
+    struct sudoku_pool * pool;
+};
+
+//
+// prototypes
+//
+
+// context
+void sudoku_defaults(sudoku_ctx_t * ctx);
+int sudoku_create(sudoku_ctx_t * ctx);
+void sudoku_destroy(sudoku_ctx_t * ctx);
+
+// solve:
+// - sudoku_solve_one returns the number of solutions found, and the first
+//   solution; an invalid puzzle has no solutions. When the solve is 
+//   checkpointed, and a checkpoint can not be written, the solve is stopped
+//   and it returns -1
+// - sudoku_count returns the number of solutions, they are not output; or
+//   -1 as sudoku_solve_one
+// - sudoku_solve_batch returns the number of puzzles solved, or -1 if the
+//   input has an invalid puzzle
+// - sudoku_count_symmetric returns the number of solutions as sudoku_count,
+//   using the puzzle's symmetries to count one solution of each orbit of
+//   symmetric solutions; max_solutions is not used; it returns -1 when
+//   more than 20 digits are absent, as the count could overflow, or when
+//   the count overflows 64 bits
+// - sudoku_unique returns SUDOKU_UNIQUE_NONE, _ONE, or _MULTIPLE, and the 
+//   solution when it is unique; the search stops at the second solution,
+//   max_solutions is not used, and nothing is output
+int64_t sudoku_solve_one(sudoku_ctx_t * ctx, sudoku_puzzle_t * puzzle, sudoku_puzzle_t * solution);
+int64_t sudoku_count(sudoku_ctx_t * ctx, sudoku_puzzle_t * puzzle);
+int64_t sudoku_count_symmetric(sudoku_ctx_t * ctx, sudoku_puzzle_t * puzzle);
+int sudoku_unique(sudoku_ctx_t * ctx, sudoku_puzzle_t * puzzle, sudoku_puzzle_t * solution);
+int64_t sudoku_solve_batch(sudoku_ctx_t * ctx, char * input, size_t len);
+char * sudoku_batch_boundary(sudoku_ctx_t * ctx, char * start, char * s, char * end);
+
+// async: the requests are solved by the worker threads while the caller
+// continues, for use by event loop services; each is solved as a batch puzzle
+// by one worker thread, up to ctx->max_solutions solutions
+// - sudoku_async_start starts serving the requests, and returns an eventfd 
+//   which is readable when there are completed requests to reap; or -1 if
+//   serving is already started. No other solves can be run on the context 
+//   until sudoku_async_stop
+// - sudoku_async_submit submits n requests, and returns the number submitted;
+//   it is less than n when SUDOKU_ASYNC_QUEUE_SIZE requests are in flight, 
+//   submitted and not yet reaped. A request must not be changed, or freed, 
+//   until it is reaped
+// - sudoku_async_reap returns up to max completed requests, in the order they
+//   completed, without blocking
+// - sudoku_async_stop waits for the requests submitted to complete, and stops
+//   serving; the eventfd is closed, and the completed requests can still be 
+//   reaped. The stats are updated. A submit concurrent with the stop 
+//   either completes before the stop returns, or returns 0
+// The requests can be submitted, and reaped, by any threads.
+int sudoku_async_start(sudoku_ctx_t * ctx);
+uint32_t sudoku_async_submit(sudoku_ctx_t * ctx, sudoku_request_t ** reqs, uint32_t n);
+uint32_t sudoku_async_reap(sudoku_ctx_t * ctx, sudoku_request_t ** reqs, uint32_t max);
+void sudoku_async_stop(sudoku_ctx_t * ctx);
+
+// latency: sudoku_latency_percentile returns the time, in ns, within which the 
+// given percentile (0 to 100) of the batch puzzles, and async requests, were
+// solved, from the latency_hist of the stats; it is the upper bound of the 
+// histogram bucket, and so is at most 1/16 more than the actual time; 0 when
+// there are none
+uint64_t sudoku_latency_percentile(sudoku_stats_t * st, double percentile);
+
+// generate: sudoku_generate generates num_puzzles minimal puzzles, each has
+// a unique solution and no clue can be removed; they are given to the batch_cb,
+// in the batch line format or as packed records, in the order of their puzzle 
+// number. The puzzles are determined by the seed, and the puzzle number, so 
+// the same puzzles are generated for any number of threads. It returns the 
+// number of puzzles generated.
+int64_t sudoku_generate(sudoku_ctx_t * ctx, uint64_t num_puzzles, uint64_t seed);
+
+// resume: sudoku_resume continues the solve checkpointed to ctx->checkpoint_file,
+// as sudoku_solve_one, or as sudoku_count when count is set; the threads and
+// engine need not be those of the checkpointed solve. It returns the number 
+// of solutions, including those found before the checkpoint, along with the
+// puzzle and the first solution; or -1 if the checkpoint file is invalid, 
+// or a checkpoint can not be written.
+int64_t sudoku_resume(sudoku_ctx_t * ctx, bool count, sudoku_puzzle_t * puzzle, sudoku_puzzle_t * solution);
+
+// distributed count: these spread a count over processes, which may be on
+// other machines, see the distributed mode of sudoku.c
+// - sudoku_expand searches the puzzle to depth branch decisions, serially; it
+//   returns the number of solutions found above the depth, and the branch 
+//   states at the depth, as num_recs packed records in recs, which the caller
+//   frees
+// - sudoku_count_states counts the solutions of num_recs branch states, packed
+//   records, as sudoku_count; max_solutions is not used. It returns -1 if 
+//   a record is invalid
+// - sudoku_checkpoint_states writes ctx->checkpoint_file, a checkpoint of the
+//   count of the puzzle, with the num_solutions counted and the branch states
+//   not yet counted; so the count can be resumed, by sudoku_resume, or by
+//   distributing the branch states again. It returns -1 if the file can not
+//   be written
+// - sudoku_checkpoint_read_states reads ctx->checkpoint_file; it returns the
+//   number of solutions of the checkpoint, along with its puzzle and branch
+//   states, which the caller frees; or -1 if the checkpoint file is invalid
+int64_t sudoku_expand(sudoku_ctx_t * ctx, sudoku_puzzle_t * puzzle, uint32_t depth, uint8_t ** recs, uint64_t * num_recs);
+int64_t sudoku_count_states(sudoku_ctx_t * ctx, uint8_t * recs, uint64_t num_recs);
+int sudoku_checkpoint_states(sudoku_ctx_t * ctx, sudoku_puzzle_t * puzzle, uint64_t num_solutions, 
+                             uint64_t num_nodes, uint64_t duration_us, uint8_t * recs, uint64_t num_recs);
+int64_t sudoku_checkpoint_read_states(sudoku_ctx_t * ctx, sudoku_puzzle_t * puzzle, uint8_t ** recs, uint64_t * num_recs);
+
+// formats
+bool sudoku_parse_line(char * s, char * end, sudoku_puzzle_t * p);
+void sudoku_pack(sudoku_puzzle_t * p, uint32_t num_solutions, uint8_t * rec);
+bool sudoku_unpack(uint8_t * rec, sudoku_puzzle_t * p);
+uint32_t sudoku_format_puzzle(sudoku_ctx_t * ctx, sudoku_puzzle_t * p, uint64_t ts, char * s);
+char * sudoku_strategy_name(uint32_t strategy);
+
+#endif